@@ -12,9 +12,44 @@
 #include <thread>
 #include <chrono>
 #include <ctime>
+#include <atomic>
+#include <algorithm>
+#include <map>
+#include <deque>
+#include <vector>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <functional>
 
 #include <zip.h>
 
+// rdtsc intrinsic is used as the cheap clock source on x86
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define MINILOGGER_HAS_RDTSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+#endif
+
+// io_uring is driven by raw syscalls, liburing is not required
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <cerrno>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define MINILOGGER_HAS_IO_URING
+#endif
+#endif
+#endif
+
 
 // include windows filesystem releated headers
 #ifdef _WIN32
@@ -42,12 +77,28 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <cerrno>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+// multi-process logging through POSIX shared memory
+#define MINILOGGER_HAS_SHARED_MEMORY
+// flush pending records on fatal signals, stack trace is symbolized by backtrace_symbols_fd
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#define MINILOGGER_HAS_CRASH_HANDLER
+#endif
+#ifdef __APPLE__
+#include <pthread.h>
+#endif
 #endif
 
 #ifdef _WIN32
-    #define NEW_LINE "\r\n"; // CRLF
+    #define NEW_LINE "\r\n" // CRLF
 #else
-    #define NEW_LINE "\n"; // LF
+    #define NEW_LINE "\n" // LF
 #endif
 
 #ifdef _WIN32
@@ -59,24 +110,235 @@
 using namespace xuranus::minilogger;
 
 namespace {
-    const uint32_t LOGGER_LEVEL_COUNT = 5;
+    const uint32_t LOGGER_LEVEL_COUNT = LOGGER_LEVEL_NUM;
     const uint32_t LOGGER_BUFFER_DEFAULT_LEN = LOGGER_MESSAGE_BUFFER_MAX_LEN + LOGGER_FUNCTION_BUFFER_MAX_LEN + 1024;
-    
-    // [datetime][level][message][function:line][threadID][threadLocalKey]
-    const char* LOG_FORMAT_STR = "[%s.%u][%s][%s][%s:%u][%llu][%s]" NEW_LINE;
+
     const std::string MINILOGGER_ARCHIVE_FILE_EXTENSION = ".zip";
+    const std::string MINILOGGER_INDEX_FILE_EXTENSION = ".idx";
+    const std::string MINILOGGER_TEMP_FILE_EXTENSION = ".tmp";
+    // next log file is created under this name ahead of rotation
+    const std::string MINILOGGER_NEXT_FILE_EXTENSION = ".next";
+    const uint64_t LOG_FILE_PREALLOCATE_SIZE_MAX = 64 * ONE_MB;
+    const char MINILOGGER_INDEX_FILE_MAGIC[8] = { 'M', 'L', 'I', 'D', 'X', '\0', '\0', '\1' };
+
+    // "MLSHMLOG", stored last by creator of shared memory segment
+    const uint64_t SHARED_LOG_MAGIC = 0x474f4c4d48534c4dULL;
+    const uint32_t SHARED_LOG_VERSION = 2;
+    const uint64_t SHARED_LOG_ALIGNMENT = 64;
+    // wait up to 1s for the creator to initialize segment
+    const uint32_t SHARED_LOG_OPEN_RETRY_MAX = 1000;
+    const uint64_t SHARED_LOG_PUBLISH_RETRY_MICROS = 100;
+    // writer sleeps this long when no record is published
+    const uint64_t SHARED_LOG_POLL_MICROS = 1000;
+    const uint64_t SHARED_LOG_RECLAIM_PERIOD_MILLIS = 1000;
+
+    // sinks flushed by fatal signal handler
+    const std::size_t CRASH_SINK_NUM_MAX = 16;
+    const int CRASH_BACKTRACE_DEPTH_MAX = 64;
+    // crash handler waits this long for consumer to finish a write it has started
+    const uint32_t CRASH_FLUSH_WAIT_MILLIS = 1000;
+
+    // owner of a write buffer, consumer and crash handler claim it by CAS so it's written exactly once
+    const uint32_t WRITE_UNCLAIMED = 0;
+    const uint32_t WRITE_BY_CONSUMER = 1;
+    const uint32_t WRITE_COMPLETED = 2;
+    const uint32_t WRITE_BY_CRASH_HANDLER = 3;
+
+    // consumer recalibrates tick clock against wall clock in this period
+    const uint64_t TICK_CLOCK_CALIBRATE_PERIOD_MICROS = 1000000;
+    // wall clock deviation larger than this is treated as a clock step instead of drift
+    const uint64_t TICK_CLOCK_RESET_THRESHOLD_MICROS = 1000000;
+    const uint64_t TICK_CLOCK_INITIAL_SAMPLE_MILLIS = 10;
+
+    const std::size_t THREAD_CONTEXT_MAX_LEN = 1024;
+    const std::size_t THREAD_CONTEXT_DEPTH_MAX = 32;
+
+    // set when the logger choose to use tick clock as ReadClock() source
+    std::atomic<bool> g_useTickClock { false };
+#ifdef MINILOGGER_HAS_RDTSC
+    // rdtsc is only used as tick source when the counter runs at constant rate across P/C-states,
+    // written by TickClock::Init() before g_useTickClock is published
+    bool g_invariantTSC = false;
+#endif
+    // raw ticks returned by ReadClock() carry this bit, so each record is converted by the clock it was read from
+    // even if clock source is switched by Init() or Destroy() in between. Neither ticks nor microseconds reach it.
+    const uint64_t TICK_TIMESTAMP_FLAG = 1ULL << 63;
+
+    // threads are numbered in order of their first record, so that they are spread over shards evenly
+    std::atomic<uint32_t> g_threadSequence { 0 };
+    // context pairs dropped for exceeding depth or length limit are reported once per process
+    std::atomic<bool> g_contextOverflowReported { false };
+#ifndef _WIN32
+    // cached to tag records published into shared memory, refreshed in forked child
+    std::atomic<int32_t> g_processID { static_cast<int32_t>(::getpid()) };
+#endif
+
+    std::atomic<int> g_guardMode { static_cast<int>(LoggerGuardMode::TRACE) };
+    // head of registered guard call sites, pushed lock-free and never removed
+    std::atomic<LoggerScopeProfile*> g_scopeProfiles { nullptr };
+}
+
+static uint64_t ReadSystemClockMicros()
+{
+    namespace chrono = std::chrono;
+    using clock = std::chrono::system_clock;
+    return chrono::duration_cast<chrono::microseconds>(clock::now().time_since_epoch()).count();
+}
+
+#ifdef MINILOGGER_HAS_RDTSC
+/**
+ * @brief check invariant TSC flag, CPUID.80000007H:EDX[8]
+ */
+static bool HasInvariantTSC()
+{
+#ifdef _MSC_VER
+    int regs[4] = { 0 };
+    __cpuid(regs, 0x80000000);
+    if (static_cast<unsigned int>(regs[0]) < 0x80000007U) {
+        return false;
+    }
+    __cpuid(regs, 0x80000007);
+    return (static_cast<unsigned int>(regs[3]) & (1U << 8)) != 0;
+#else
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0) {
+        return false;
+    }
+    return (edx & (1U << 8)) != 0;
+#endif
+}
+#endif
+
+/**
+ * @brief read raw ticks, rdtsc on x86 with invariant TSC and steady_clock nanoseconds otherwise
+ */
+static inline uint64_t ReadTicks()
+{
+#ifdef MINILOGGER_HAS_RDTSC
+    if (g_invariantTSC) {
+        return __rdtsc();
+    }
+#endif
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-// TODO:: use the constexpr version
-static std::string FormatFunction(const char* functionMacroLiteral)
+uint64_t xuranus::minilogger::ReadClock()
 {
-    std::string function = functionMacroLiteral;
-    if (function.length() >= LOGGER_FUNCTION_BUFFER_MAX_LEN) {
-        function = function.substr(0, LOGGER_FUNCTION_BUFFER_MAX_LEN);
+    if (g_useTickClock.load(std::memory_order_acquire)) {
+        return ReadTicks() | TICK_TIMESTAMP_FLAG;
     }
-    return function;
+    return ReadSystemClockMicros();
 }
 
+/**
+ * @brief convert raw ticks to wall-clock microseconds
+ * The mapping is a continuous piecewise linear function, each calibration starts a new segment from the
+ * current mapped value and steers its slope to meet the wall clock at the end of next period,
+ * so converted timestamps never go backwards while staying close to the wall clock.
+ * Calibrate() is invoked by the consumer thread only, readers are protected by a sequence lock.
+ */
+class TickClock {
+public:
+    void Init()
+    {
+#ifdef MINILOGGER_HAS_RDTSC
+        // TSC without invariant flag may change rate or stop with frequency scaling, fallback to steady_clock
+        g_invariantTSC = HasInvariantTSC();
+#endif
+        uint64_t ticks1 = ReadTicks();
+        uint64_t micros1 = ReadSystemClockMicros();
+        uint64_t ticks2 = ticks1;
+        uint64_t micros2 = micros1;
+        double microsPerTick = 1.0 / 1000.0; // steady_clock nanoseconds
+#ifdef MINILOGGER_HAS_RDTSC
+        if (g_invariantTSC) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(TICK_CLOCK_INITIAL_SAMPLE_MILLIS));
+            ticks2 = ReadTicks();
+            micros2 = ReadSystemClockMicros();
+            microsPerTick = (ticks2 > ticks1 && micros2 > micros1) ?
+                static_cast<double>(micros2 - micros1) / static_cast<double>(ticks2 - ticks1) : 0.0;
+            if (microsPerTick <= 0.0) {
+                microsPerTick = 1.0 / 1000.0; // assume 1GHz, will be corrected by next calibration
+            }
+        }
+#endif
+        m_originTicks = ticks1;
+        m_originMicros = micros1;
+        m_rate = microsPerTick;
+        Publish(ticks2, micros2, microsPerTick);
+    }
+
+    void Calibrate()
+    {
+        uint64_t ticks = ReadTicks();
+        uint64_t wall = ReadSystemClockMicros();
+        uint64_t mapped = ToMicroseconds(ticks);
+        if (ticks > m_originTicks && wall > m_originMicros) {
+            // long term average rate is more stable than the short initial sample
+            m_rate = static_cast<double>(wall - m_originMicros) / static_cast<double>(ticks - m_originTicks);
+        }
+        uint64_t deviation = mapped > wall ? mapped - wall : wall - mapped;
+        if (deviation > TICK_CLOCK_RESET_THRESHOLD_MICROS) {
+            // wall clock is stepped, restart from here
+            m_originTicks = ticks;
+            m_originMicros = wall;
+            Publish(ticks, wall, m_rate);
+            return;
+        }
+        double period = static_cast<double>(TICK_CLOCK_CALIBRATE_PERIOD_MICROS);
+        double slope = (static_cast<double>(wall) + period - static_cast<double>(mapped)) / (period / m_rate);
+        slope = std::max(slope, m_rate * 0.5);
+        slope = std::min(slope, m_rate * 1.5);
+        Publish(ticks, mapped, slope);
+    }
+
+    uint64_t ToMicroseconds(uint64_t ticks) const
+    {
+        uint64_t baseTicks = 0;
+        uint64_t baseMicros = 0;
+        double slope = 0.0;
+        uint32_t sequence = 0;
+        do {
+            sequence = m_sequence.load(std::memory_order_acquire);
+            baseTicks = m_baseTicks.load(std::memory_order_relaxed);
+            baseMicros = m_baseMicros.load(std::memory_order_relaxed);
+            uint64_t slopeBits = m_slopeBits.load(std::memory_order_relaxed);
+            std::memcpy(&slope, &slopeBits, sizeof(slope));
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((sequence & 1) != 0 || sequence != m_sequence.load(std::memory_order_relaxed));
+        if (ticks >= baseTicks) {
+            return baseMicros + static_cast<uint64_t>(static_cast<double>(ticks - baseTicks) * slope);
+        }
+        uint64_t delta = static_cast<uint64_t>(static_cast<double>(baseTicks - ticks) * slope);
+        return delta < baseMicros ? baseMicros - delta : 0;
+    }
+
+private:
+    void Publish(uint64_t baseTicks, uint64_t baseMicros, double slope)
+    {
+        uint64_t slopeBits = 0;
+        std::memcpy(&slopeBits, &slope, sizeof(slope));
+        uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_baseTicks.store(baseTicks, std::memory_order_relaxed);
+        m_baseMicros.store(baseMicros, std::memory_order_relaxed);
+        m_slopeBits.store(slopeBits, std::memory_order_relaxed);
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+private:
+    std::atomic<uint32_t>   m_sequence { 0 };
+    std::atomic<uint64_t>   m_baseTicks { 0 };
+    std::atomic<uint64_t>   m_baseMicros { 0 };
+    std::atomic<uint64_t>   m_slopeBits { 0 };
+    // only accessed by calibrating thread
+    uint64_t                m_originTicks { 0 };
+    uint64_t                m_originMicros { 0 };
+    double                  m_rate { 0.0 };
+};
+
 static int GetCurrentTimezoneOffset()
 {
     std::time_t currentTime = std::time(nullptr);
@@ -87,8 +349,17 @@ static int GetCurrentTimezoneOffset()
     return -timezoneOffset;
 }
 
-// Function to format a timestamp to a datetime string
-static std::string ParseDateTimeFromSeconds(uint64_t timestamp, uint64_t timestampOffset)
+struct DateTime {
+    int64_t year;
+    int64_t month;
+    int64_t day;
+    int64_t hours;
+    int64_t minutes;
+    int64_t seconds;
+};
+
+// Function to split a timestamp into datetime components
+static DateTime ParseDateTimeFromSeconds(uint64_t timestamp, uint64_t timestampOffset)
 {
     timestamp += timestampOffset;
     // Calculate the individual components
@@ -131,32 +402,634 @@ static std::string ParseDateTimeFromSeconds(uint64_t timestamp, uint64_t timesta
             days -= monthDays[month - 1];
         }
     }
+    return DateTime { year, month, day, hours, minutes, seconds };
+}
+
+/**
+ * @brief append formatted content to a fixed size buffer without heap allocation
+ * Content exceeding the capacity is discarded but still counted by Length(),
+ * so the caller can retry with a buffer large enough.
+ */
+class RecordWriter {
+public:
+    RecordWriter(char* buffer, std::size_t capacity)
+        : m_buffer(buffer), m_capacity(capacity)
+    {}
+
+    void Append(const char* str, std::size_t length)
+    {
+        if (m_length < m_capacity) {
+            std::memcpy(m_buffer + m_length, str, std::min(length, m_capacity - m_length));
+        }
+        m_length += length;
+    }
+
+    void Append(const char* str)
+    {
+        Append(str, std::strlen(str));
+    }
+
+    void Append(char c)
+    {
+        if (m_length < m_capacity) {
+            m_buffer[m_length] = c;
+        }
+        m_length++;
+    }
+
+    // append unsigned integer, left padding with '0' to at least width digits
+    void AppendUInt(uint64_t value, int width = 0)
+    {
+        char digits[20];
+        int n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        for (; n < width; width--) {
+            Append('0');
+        }
+        while (n > 0) {
+            Append(digits[--n]);
+        }
+    }
+
+    void AppendInt(int64_t value)
+    {
+        if (value < 0) {
+            Append('-');
+            AppendUInt(static_cast<uint64_t>(-(value + 1)) + 1);
+            return;
+        }
+        AppendUInt(static_cast<uint64_t>(value));
+    }
+
+    void AppendDouble(double value)
+    {
+        char digits[32] = { '\0' };
+        int n = ::snprintf(digits, sizeof(digits), "%.17g", value);
+        if (n > 0) {
+            Append(digits, std::min(static_cast<std::size_t>(n), sizeof(digits) - 1));
+        }
+    }
+
+    // yyyy-mm-dd HH:MM:SS.uuuuuu
+    void AppendDateTime(const DateTime& datetime, uint32_t microSeconds)
+    {
+        AppendUInt(datetime.year, 4);
+        Append('-');
+        AppendUInt(datetime.month, 2);
+        Append('-');
+        AppendUInt(datetime.day, 2);
+        Append(' ');
+        AppendUInt(datetime.hours, 2);
+        Append(':');
+        AppendUInt(datetime.minutes, 2);
+        Append(':');
+        AppendUInt(datetime.seconds, 2);
+        Append('.');
+        AppendUInt(microSeconds, 6);
+    }
+
+    // append a quoted JSON string, escape quote, backslash and control characters
+    void AppendJsonString(const char* str, std::size_t length)
+    {
+        static const char HEX_DIGITS[] = "0123456789abcdef";
+        Append('"');
+        std::size_t begin = 0;
+        for (std::size_t i = 0; i < length; i++) {
+            unsigned char c = static_cast<unsigned char>(str[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            Append(str + begin, i - begin);
+            begin = i + 1;
+            Append('\\');
+            switch (c) {
+                case '"': Append('"'); break;
+                case '\\': Append('\\'); break;
+                case '\n': Append('n'); break;
+                case '\r': Append('r'); break;
+                case '\t': Append('t'); break;
+                case '\b': Append('b'); break;
+                case '\f': Append('f'); break;
+                default:
+                    Append("u00", 3);
+                    Append(HEX_DIGITS[c >> 4]);
+                    Append(HEX_DIGITS[c & 0xF]);
+                    break;
+            }
+        }
+        Append(str + begin, length - begin);
+        Append('"');
+    }
+
+    // two lower case hex digits per byte
+    void AppendHex(const void* data, std::size_t length)
+    {
+        AppendBinary(data, length, length * 2, 1, EncodeHex);
+    }
+
+    // standard base64 with '=' padding
+    void AppendBase64(const void* data, std::size_t length)
+    {
+        AppendBinary(data, length, (length + 2) / 3 * 4, 3, EncodeBase64);
+    }
+
+    std::size_t Length() const
+    {
+        return m_length;
+    }
+
+private:
+    using BinaryEncoder = std::size_t (*)(const unsigned char* data, std::size_t length, char* output);
+
+    /**
+     * @brief encode straight into buffer if it fits, only a partially fitting tail goes through
+     * a small chunk, bytes are only counted and never encoded once buffer is full
+     */
+    void AppendBinary(const void* data, std::size_t length, std::size_t encodedLength,
+        std::size_t groupSize, BinaryEncoder encoder)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        if (m_length >= m_capacity) {
+            m_length += encodedLength;
+            return;
+        }
+        if (m_capacity - m_length >= encodedLength) {
+            m_length += encoder(bytes, length, m_buffer + m_length);
+            return;
+        }
+        // whole groups whose encoding fits in chunk, at most two chars per byte
+        char chunk[256];
+        std::size_t chunkBytes = sizeof(chunk) / 2 / groupSize * groupSize;
+        std::size_t encoded = 0;
+        for (std::size_t i = 0; i < length && m_length < m_capacity; i += chunkBytes) {
+            std::size_t n = std::min(chunkBytes, length - i);
+            std::size_t chunkLength = encoder(bytes + i, n, chunk);
+            Append(chunk, chunkLength);
+            encoded += chunkLength;
+        }
+        m_length += encodedLength - encoded;
+    }
+
+    static std::size_t EncodeHex(const unsigned char* data, std::size_t length, char* output)
+    {
+        static const char HEX_DIGITS[] = "0123456789abcdef";
+        for (std::size_t i = 0; i < length; i++) {
+            output[i * 2] = HEX_DIGITS[data[i] >> 4];
+            output[i * 2 + 1] = HEX_DIGITS[data[i] & 0xF];
+        }
+        return length * 2;
+    }
+
+    static std::size_t EncodeBase64(const unsigned char* data, std::size_t length, char* output)
+    {
+        static const char BASE64_DIGITS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        char* p = output;
+        std::size_t i = 0;
+        for (; i + 3 <= length; i += 3) {
+            uint32_t group = (static_cast<uint32_t>(data[i]) << 16) |
+                (static_cast<uint32_t>(data[i + 1]) << 8) | data[i + 2];
+            *p++ = BASE64_DIGITS[(group >> 18) & 0x3F];
+            *p++ = BASE64_DIGITS[(group >> 12) & 0x3F];
+            *p++ = BASE64_DIGITS[(group >> 6) & 0x3F];
+            *p++ = BASE64_DIGITS[group & 0x3F];
+        }
+        if (i < length) {
+            uint32_t group = static_cast<uint32_t>(data[i]) << 16;
+            if (i + 1 < length) {
+                group |= static_cast<uint32_t>(data[i + 1]) << 8;
+            }
+            *p++ = BASE64_DIGITS[(group >> 18) & 0x3F];
+            *p++ = BASE64_DIGITS[(group >> 12) & 0x3F];
+            *p++ = i + 1 < length ? BASE64_DIGITS[(group >> 6) & 0x3F] : '=';
+            *p++ = '=';
+        }
+        return static_cast<std::size_t>(p - output);
+    }
+
+private:
+    char*           m_buffer;
+    std::size_t     m_capacity;
+    std::size_t     m_length { 0 };
+};
+
+/**
+ * @brief per-thread context block, thread id and context strings are formatted once
+ * when they change and copied into each record as they are.
+ * It's zero initialized as a trivial type, so thread_local access needs no init guard.
+ */
+struct ThreadContext {
+    bool            inited;
+    uint64_t        threadID;
+    char            threadIDStr[24];
+    std::size_t     threadIDStrLength;
+    // thread local key, raw text and JSON quoted string
+    char            keyText[LOGGER_THREAD_LOCAL_KEY_MAX_LEN];
+    std::size_t     keyTextLength;
+    // room for the longest key with every byte escaped as \u00XX
+    char            keyJson[LOGGER_THREAD_LOCAL_KEY_MAX_LEN * 6 + 2];
+    std::size_t     keyJsonLength;
+    // scoped context pairs, "k1=v1 k2=v2" for text and "k1":"v1","k2":"v2" for JSON
+    char            contextText[THREAD_CONTEXT_MAX_LEN];
+    std::size_t     contextTextLength;
+    char            contextJson[THREAD_CONTEXT_MAX_LEN * 2];
+    std::size_t     contextJsonLength;
+    // lengths to restore when pop
+    std::size_t     stackTextLength[THREAD_CONTEXT_DEPTH_MAX];
+    std::size_t     stackJsonLength[THREAD_CONTEXT_DEPTH_MAX];
+    std::size_t     depth;
+    uint32_t        sequence;
+};
+
+thread_local ThreadContext g_threadContext;
+
+#ifdef MINILOGGER_HAS_CRASH_HANDLER
+namespace {
+    const std::size_t CRASH_SIGNAL_STACK_SIZE = 64 * 1024;
+    // set once crash handler is installed, threads logging since then get an alternate signal stack
+    std::atomic<bool> g_crashHandlerActive { false };
+}
+
+/**
+ * @brief alternate signal stack of current thread, so that crash handler also runs on stack overflow.
+ * A thread which already has one, set up by the application, keeps it.
+ */
+class CrashSignalStack {
+public:
+    CrashSignalStack()
+    {
+        stack_t current;
+        if (::sigaltstack(nullptr, &current) != 0 || (current.ss_flags & SS_DISABLE) == 0) {
+            return;
+        }
+        void* memory = ::mmap(nullptr, CRASH_SIGNAL_STACK_SIZE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return;
+        }
+        stack_t stack;
+        std::memset(&stack, 0, sizeof(stack));
+        stack.ss_sp = memory;
+        stack.ss_size = CRASH_SIGNAL_STACK_SIZE;
+        if (::sigaltstack(&stack, nullptr) != 0) {
+            ::munmap(memory, CRASH_SIGNAL_STACK_SIZE);
+            return;
+        }
+        m_memory = memory;
+    }
+
+    ~CrashSignalStack()
+    {
+        if (m_memory == nullptr) {
+            return;
+        }
+        stack_t stack;
+        std::memset(&stack, 0, sizeof(stack));
+        stack.ss_flags = SS_DISABLE;
+        ::sigaltstack(&stack, nullptr);
+        ::munmap(m_memory, CRASH_SIGNAL_STACK_SIZE);
+    }
+
+private:
+    void* m_memory { nullptr };
+};
+
+static void SetupCrashSignalStack()
+{
+    // constructed on first call of each thread and released at thread exit
+    static thread_local CrashSignalStack stack;
+    (void)stack;
+}
+#endif
+
+static uint64_t GetOSThreadID()
+{
+#if defined(_WIN32)
+    return static_cast<uint64_t>(::GetCurrentThreadId());
+#elif defined(__linux__)
+    return static_cast<uint64_t>(::syscall(SYS_gettid));
+#elif defined(__APPLE__)
+    uint64_t threadID = 0;
+    ::pthread_threadid_np(nullptr, &threadID);
+    return threadID;
+#else
+    static std::hash<std::thread::id> ThreadIDHasher;
+    return ThreadIDHasher(std::this_thread::get_id());
+#endif
+}
+
+static ThreadContext& GetThreadContext()
+{
+    ThreadContext& context = g_threadContext;
+    if (!context.inited) {
+        context.threadID = GetOSThreadID();
+        RecordWriter writer(context.threadIDStr, sizeof(context.threadIDStr));
+        writer.AppendUInt(context.threadID);
+        context.threadIDStrLength = writer.Length();
+        context.keyJson[0] = '"';
+        context.keyJson[1] = '"';
+        context.keyJsonLength = 2;
+        context.sequence = g_threadSequence.fetch_add(1, std::memory_order_relaxed);
+        context.inited = true;
+#ifdef MINILOGGER_HAS_CRASH_HANDLER
+        if (g_crashHandlerActive.load(std::memory_order_relaxed)) {
+            SetupCrashSignalStack();
+        }
+#endif
+    }
+    return context;
+}
+
+#ifndef _WIN32
+/**
+ * @brief forked child runs on a copy of the forking thread, whose cached thread id belongs to parent
+ */
+static void RefreshProcessAfterFork()
+{
+    g_processID.store(static_cast<int32_t>(::getpid()), std::memory_order_relaxed);
+    ThreadContext& context = g_threadContext;
+    if (context.inited) {
+        context.threadID = GetOSThreadID();
+        RecordWriter writer(context.threadIDStr, sizeof(context.threadIDStr));
+        writer.AppendUInt(context.threadID);
+        context.threadIDStrLength = writer.Length();
+    }
+}
+
+static const int g_forkHandlerRegistered = ::pthread_atfork(nullptr, nullptr, RefreshProcessAfterFork);
+#endif
+
+static void SetThreadContextKey(const std::string& key)
+{
+    ThreadContext& context = GetThreadContext();
+    std::size_t keyLength = key.length();
+    if (keyLength > LOGGER_THREAD_LOCAL_KEY_MAX_LEN) {
+        keyLength = LOGGER_THREAD_LOCAL_KEY_MAX_LEN;
+        // do not split a multi-byte character, the cut point must not be a continuation byte
+        while (keyLength > 0 && (static_cast<unsigned char>(key[keyLength]) & 0xC0) == 0x80) {
+            keyLength--;
+        }
+    }
+    std::memcpy(context.keyText, key.c_str(), keyLength);
+    context.keyTextLength = keyLength;
+    RecordWriter writer(context.keyJson, sizeof(context.keyJson));
+    writer.AppendJsonString(key.c_str(), keyLength);
+    context.keyJsonLength = writer.Length();
+}
+
+template<class... Args>
+void InternalErrorLog(const char* format, Args... args);
+
+static void ReportThreadContextOverflow(const char* key)
+{
+    if (!g_contextOverflowReported.exchange(true, std::memory_order_relaxed)) {
+        InternalErrorLog("context %s is omitted, context is limited to %zu pairs and %zu bytes",
+            key, THREAD_CONTEXT_DEPTH_MAX, THREAD_CONTEXT_MAX_LEN);
+    }
+}
+
+static bool PushThreadContext(const char* key, const char* value, std::size_t valueLength)
+{
+    ThreadContext& context = GetThreadContext();
+    if (context.depth >= THREAD_CONTEXT_DEPTH_MAX) {
+        ReportThreadContextOverflow(key);
+        return false;
+    }
+    std::size_t textLength = context.contextTextLength;
+    std::size_t jsonLength = context.contextJsonLength;
+    RecordWriter textWriter(context.contextText + textLength, sizeof(context.contextText) - textLength);
+    if (textLength != 0) {
+        textWriter.Append(' ');
+    }
+    textWriter.Append(key);
+    textWriter.Append('=');
+    textWriter.Append(value, valueLength);
+    RecordWriter jsonWriter(context.contextJson + jsonLength, sizeof(context.contextJson) - jsonLength);
+    if (jsonLength != 0) {
+        jsonWriter.Append(',');
+    }
+    jsonWriter.AppendJsonString(key, std::strlen(key));
+    jsonWriter.Append(':');
+    jsonWriter.AppendJsonString(value, valueLength);
+    context.stackTextLength[context.depth] = textLength;
+    context.stackJsonLength[context.depth] = jsonLength;
+    context.depth++;
+    if (textLength + textWriter.Length() <= sizeof(context.contextText) &&
+        jsonLength + jsonWriter.Length() <= sizeof(context.contextJson)) {
+        context.contextTextLength += textWriter.Length();
+        context.contextJsonLength += jsonWriter.Length();
+    } else {
+        // pair overflowing the context buffer is omitted, but still occupy a stack level
+        ReportThreadContextOverflow(key);
+    }
+    return true;
+}
+
+static void PopThreadContext()
+{
+    ThreadContext& context = GetThreadContext();
+    if (context.depth == 0) {
+        return;
+    }
+    context.depth--;
+    context.contextTextLength = context.stackTextLength[context.depth];
+    context.contextJsonLength = context.stackJsonLength[context.depth];
+}
+
+/**
+ * @brief all information of a single log record used by encoders
+ */
+struct LogRecord {
+    LoggerLevel         level;
+    const char*         function;
+    uint32_t            line;
+    const char*         message;
+    const LoggerField*  fields;
+    std::size_t         fieldsNum;
+    uint64_t            timestamp;          // wall clock microseconds
+    uint64_t            timezoneOffset;     // timezone offset in seconds
+    const ThreadContext* context;
+    const char*         module;             // name of module logger, null for root logger
+    int32_t             pid;                // producer process of record merged through shared memory, 0 otherwise
+};
+
+static const char* g_loggerLevelStr[LOGGER_LEVEL_COUNT] = {
+    "DBG",
+    "INFO",
+    "WARN",
+    "ERR",
+    "FATAL"
+};
+
+static std::size_t FunctionLength(const char* function)
+{
+    const void* end = std::memchr(function, '\0', LOGGER_FUNCTION_BUFFER_MAX_LEN);
+    return end == nullptr ? LOGGER_FUNCTION_BUFFER_MAX_LEN : static_cast<const char*>(end) - function;
+}
+
+static void WriteBytesFieldValue(RecordWriter& writer, const LoggerBytesRef& bytes)
+{
+    if (bytes.encoding == LoggerBytesEncoding::BASE64) {
+        writer.AppendBase64(bytes.data, bytes.length);
+    } else {
+        writer.AppendHex(bytes.data, bytes.length);
+    }
+}
+
+static void WriteTextFieldValue(RecordWriter& writer, const LoggerField& field)
+{
+    switch (field.type) {
+        case LoggerFieldType::INT: writer.AppendInt(field.intValue); break;
+        case LoggerFieldType::UINT: writer.AppendUInt(field.uintValue); break;
+        case LoggerFieldType::DOUBLE: writer.AppendDouble(field.doubleValue); break;
+        case LoggerFieldType::BOOL: writer.Append(field.boolValue ? "true" : "false"); break;
+        case LoggerFieldType::STRING: writer.Append(field.stringValue.data, field.stringValue.length); break;
+        case LoggerFieldType::BYTES: WriteBytesFieldValue(writer, field.bytesValue); break;
+    }
+}
+
+static void WriteJsonFieldValue(RecordWriter& writer, const LoggerField& field)
+{
+    switch (field.type) {
+        case LoggerFieldType::INT: writer.AppendInt(field.intValue); break;
+        case LoggerFieldType::UINT: writer.AppendUInt(field.uintValue); break;
+        case LoggerFieldType::DOUBLE:
+            // NaN and Infinity are not representable in JSON
+            if (field.doubleValue != field.doubleValue ||
+                field.doubleValue > std::numeric_limits<double>::max() ||
+                field.doubleValue < -std::numeric_limits<double>::max()) {
+                writer.Append("null", 4);
+            } else {
+                writer.AppendDouble(field.doubleValue);
+            }
+            break;
+        case LoggerFieldType::BOOL: writer.Append(field.boolValue ? "true" : "false"); break;
+        case LoggerFieldType::STRING:
+            writer.AppendJsonString(field.stringValue.data, field.stringValue.length);
+            break;
+        case LoggerFieldType::BYTES:
+            // hex and base64 digits never need escaping
+            writer.Append('"');
+            WriteBytesFieldValue(writer, field.bytesValue);
+            writer.Append('"');
+            break;
+    }
+}
 
-    // Build the datetime string
-    std::string datetime = std::to_string(year) + "-";
-    if (month < 10) {
-        datetime += "0";
+// [datetime][level][message key=value...][function:line][pid:threadID][threadLocalKey key=value...],
+// pid is written only for records published into shared memory
+static void EncodeTextRecord(RecordWriter& writer, const LogRecord& record)
+{
+    writer.Append('[');
+    writer.AppendDateTime(
+        ParseDateTimeFromSeconds(record.timestamp / 1000000, record.timezoneOffset),
+        static_cast<uint32_t>(record.timestamp % 1000000));
+    writer.Append("][", 2);
+    writer.Append(g_loggerLevelStr[static_cast<uint32_t>(record.level)]);
+    writer.Append("][", 2);
+    writer.Append(record.message);
+    for (std::size_t i = 0; i < record.fieldsNum; i++) {
+        writer.Append(' ');
+        writer.Append(record.fields[i].key);
+        writer.Append('=');
+        WriteTextFieldValue(writer, record.fields[i]);
     }
-    datetime += std::to_string(month) + "-";
-    if (day < 10) {
-        datetime += "0";
+    writer.Append("][", 2);
+    writer.Append(record.function, FunctionLength(record.function));
+    writer.Append(':');
+    writer.AppendUInt(record.line);
+    writer.Append("][", 2);
+    if (record.pid != 0) {
+        writer.AppendInt(record.pid);
+        writer.Append(':');
     }
-    datetime += std::to_string(day) + " ";
+    writer.Append(record.context->threadIDStr, record.context->threadIDStrLength);
+    writer.Append("][", 2);
+    writer.Append(record.context->keyText, record.context->keyTextLength);
+    if (record.context->keyTextLength != 0 && record.context->contextTextLength != 0) {
+        writer.Append(' ');
+    }
+    writer.Append(record.context->contextText, record.context->contextTextLength);
+    writer.Append(']');
+    writer.Append(NEW_LINE);
+}
 
-    if (hours < 10) {
-        datetime += "0";
+// {"time":...,"ts":...,"logger":...,"level":...,"msg":...,"func":...,"line":...,"pid":...,"tid":...,"key":...,
+// "ctx":{...},fields...}, pid is written only for records published into shared memory
+static void EncodeJsonRecord(RecordWriter& writer, const LogRecord& record)
+{
+    writer.Append("{\"time\":\"", 9);
+    writer.AppendDateTime(
+        ParseDateTimeFromSeconds(record.timestamp / 1000000, record.timezoneOffset),
+        static_cast<uint32_t>(record.timestamp % 1000000));
+    writer.Append("\",\"ts\":", 7);
+    writer.AppendUInt(record.timestamp);
+    if (record.module != nullptr) {
+        writer.Append(",\"logger\":", 10);
+        writer.AppendJsonString(record.module, std::strlen(record.module));
+    }
+    writer.Append(",\"level\":\"", 10);
+    writer.Append(g_loggerLevelStr[static_cast<uint32_t>(record.level)]);
+    writer.Append("\",\"msg\":", 8);
+    writer.AppendJsonString(record.message, std::strlen(record.message));
+    writer.Append(",\"func\":", 8);
+    writer.AppendJsonString(record.function, FunctionLength(record.function));
+    writer.Append(",\"line\":", 8);
+    writer.AppendUInt(record.line);
+    if (record.pid != 0) {
+        writer.Append(",\"pid\":", 7);
+        writer.AppendInt(record.pid);
     }
-    datetime += std::to_string(hours) + ":";
-    if (minutes < 10) {
-        datetime += "0";
+    writer.Append(",\"tid\":", 7);
+    writer.Append(record.context->threadIDStr, record.context->threadIDStrLength);
+    writer.Append(",\"key\":", 7);
+    writer.Append(record.context->keyJson, record.context->keyJsonLength);
+    if (record.context->contextJsonLength != 0) {
+        writer.Append(",\"ctx\":{", 8);
+        writer.Append(record.context->contextJson, record.context->contextJsonLength);
+        writer.Append('}');
     }
-    datetime += std::to_string(minutes) + ":";
-    if (seconds < 10) {
-        datetime += "0";
+    for (std::size_t i = 0; i < record.fieldsNum; i++) {
+        writer.Append(',');
+        writer.AppendJsonString(record.fields[i].key, std::strlen(record.fields[i].key));
+        writer.Append(':');
+        WriteJsonFieldValue(writer, record.fields[i]);
     }
-    datetime += std::to_string(seconds);
+    writer.Append('}');
+    writer.Append(NEW_LINE);
+}
+
+// return length of the whole record even if it's truncated, buffer can be null with capacity 0 to count length only
+static std::size_t EncodeRecord(LoggerFormat format, char* buffer, std::size_t capacity, const LogRecord& record)
+{
+    RecordWriter writer(buffer, capacity);
+    if (format == LoggerFormat::JSON) {
+        EncodeJsonRecord(writer, record);
+    } else {
+        EncodeTextRecord(writer, record);
+    }
+    return writer.Length();
+}
 
-    return datetime;
+/**
+ * @brief bytes of message and string or binary field values, a record with large payload is
+ * encoded right into the sink buffer instead of a stack buffer
+ */
+static std::size_t RecordPayloadLength(const LogRecord& record)
+{
+    std::size_t length = std::strlen(record.message);
+    for (std::size_t i = 0; i < record.fieldsNum; i++) {
+        const LoggerField& field = record.fields[i];
+        if (field.type == LoggerFieldType::STRING) {
+            length += field.stringValue.length;
+        } else if (field.type == LoggerFieldType::BYTES) {
+            length += field.bytesValue.encoding == LoggerBytesEncoding::BASE64 ?
+                (field.bytesValue.length + 2) / 3 * 4 : field.bytesValue.length * 2;
+        }
+    }
+    return length;
 }
 
 template<class... Args>
@@ -224,14 +1097,821 @@ bool RemoveFile(const std::string& path)
     return ::remove(path.c_str()) == 0;
 #endif
 }
-}
 
-/**
- * @brief Logger implementation, used to prevent header corruption
- */
-class LoggerImpl : public Logger {
-public:
-    LoggerImpl();
+bool Exists(const std::string& path)
+{
+#if defined (_WIN32)
+    return ::GetFileAttributesW(Utf8ToUtf16(path).c_str()) != INVALID_FILE_ATTRIBUTES;
+#else
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0;
+#endif
+}
+
+// reserve disk space without changing file size, only supported on Linux
+bool PreallocateFile(const std::string& path, uint64_t size)
+{
+#if defined (__linux__)
+    int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ret = ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size)) == 0;
+    ::close(fd);
+    return ret;
+#else
+    (void)path;
+    (void)size;
+    return false;
+#endif
+}
+
+// return 0 if file not exists
+uint64_t GetFileSize(const std::string& path)
+{
+#if defined (_WIN32)
+    WIN32_FILE_ATTRIBUTE_DATA attribute;
+    if (!::GetFileAttributesExW(Utf8ToUtf16(path).c_str(), GetFileExInfoStandard, &attribute)) {
+        return 0;
+    }
+    return (static_cast<uint64_t>(attribute.nFileSizeHigh) << 32) | attribute.nFileSizeLow;
+#else
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(st.st_size);
+#endif
+}
+}
+
+#ifdef MINILOGGER_HAS_IO_URING
+/**
+ * @brief minimal io_uring instance submitting file writes, driven by raw syscalls
+ */
+class IOUring {
+public:
+    ~IOUring();
+
+    // return false if io_uring is not supported by kernel or forbidden by seccomp
+    bool Init(uint32_t entries);
+
+    // queue a writev of iovNum iovecs at file offset and submit it, userData is returned with its completion
+    bool SubmitWrite(int fd, const struct iovec* iov, uint32_t iovNum, uint64_t offset, uint64_t userData);
+
+    // pop a completion, wait for one if wait is true and none is ready
+    bool PopCompletion(bool wait, uint64_t& userData, int32_t& result);
+
+private:
+    int Enter(uint32_t toSubmit, uint32_t minComplete, uint32_t flags);
+
+private:
+    int                     m_ringFd { -1 };
+    uint32_t                m_sqEntries { 0 };
+    void*                   m_sqRing { nullptr };
+    std::size_t             m_sqRingSize { 0 };
+    void*                   m_cqRing { nullptr };
+    std::size_t             m_cqRingSize { 0 };
+    struct io_uring_sqe*    m_sqes { nullptr };
+    std::size_t             m_sqesSize { 0 };
+    unsigned*               m_sqHead { nullptr };
+    unsigned*               m_sqTail { nullptr };
+    unsigned*               m_sqMask { nullptr };
+    unsigned*               m_sqArray { nullptr };
+    unsigned*               m_cqHead { nullptr };
+    unsigned*               m_cqTail { nullptr };
+    unsigned*               m_cqMask { nullptr };
+    struct io_uring_cqe*    m_cqes { nullptr };
+};
+
+IOUring::~IOUring()
+{
+    if (m_sqes != nullptr) {
+        ::munmap(m_sqes, m_sqesSize);
+    }
+    if (m_cqRing != nullptr) {
+        ::munmap(m_cqRing, m_cqRingSize);
+    }
+    if (m_sqRing != nullptr) {
+        ::munmap(m_sqRing, m_sqRingSize);
+    }
+    if (m_ringFd >= 0) {
+        ::close(m_ringFd);
+    }
+}
+
+bool IOUring::Init(uint32_t entries)
+{
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    m_ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (m_ringFd < 0) {
+        return false;
+    }
+    m_sqEntries = params.sq_entries;
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqRing = ::mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+    m_sqRing = sqRing == MAP_FAILED ? nullptr : sqRing;
+    void* cqRing = ::mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+    m_cqRing = cqRing == MAP_FAILED ? nullptr : cqRing;
+    void* sqes = ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+    m_sqes = sqes == MAP_FAILED ? nullptr : static_cast<struct io_uring_sqe*>(sqes);
+    if (m_sqRing == nullptr || m_cqRing == nullptr || m_sqes == nullptr) {
+        return false;
+    }
+    char* sq = static_cast<char*>(m_sqRing);
+    m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(m_cqRing);
+    m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+int IOUring::Enter(uint32_t toSubmit, uint32_t minComplete, uint32_t flags)
+{
+    int ret = 0;
+    do {
+        ret = static_cast<int>(::syscall(__NR_io_uring_enter, m_ringFd, toSubmit, minComplete, flags, nullptr, 0));
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+bool IOUring::SubmitWrite(int fd, const struct iovec* iov, uint32_t iovNum, uint64_t offset, uint64_t userData)
+{
+    // submission queue is only written by this thread, head is advanced by kernel
+    unsigned tail = *m_sqTail;
+    if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries) {
+        return false;
+    }
+    unsigned index = tail & *m_sqMask;
+    struct io_uring_sqe* sqe = &m_sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(iov);
+    sqe->len = iovNum;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    m_sqArray[index] = index;
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+    if (Enter(1, 0, 0) == 1) {
+        return true;
+    }
+    // kernel only consumes entries inside io_uring_enter. Take back the entry it did not consume, otherwise
+    // the next enter submits it again after caller has written the buffer synchronously and reused it
+    if (__atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) == tail) {
+        __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+        return false;
+    }
+    // consumed although enter failed, its completion is reaped as usual
+    return true;
+}
+
+bool IOUring::PopCompletion(bool wait, uint64_t& userData, int32_t& result)
+{
+    while (true) {
+        unsigned head = *m_cqHead;
+        if (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+            const struct io_uring_cqe& cqe = m_cqes[head & *m_cqMask];
+            userData = cqe.user_data;
+            result = cqe.res;
+            __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+        if (!wait || Enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+            return false;
+        }
+    }
+}
+#endif
+
+#ifdef MINILOGGER_HAS_SHARED_MEMORY
+/**
+ * @brief header of a record published into shared memory ring, followed by the encoded record
+ */
+struct SharedLogRecordHeader {
+    uint32_t        length;     // bytes of encoded record
+    uint32_t        level;
+    uint64_t        timestamp;  // microseconds since epoch, used by writer to merge rings
+};
+
+/**
+ * @brief single producer single consumer byte ring owned by one producer process, followed by ringSize bytes.
+ * head and tail are monotonic byte counters, [tail, head) holds committed records not drained by writer yet.
+ * Records are copied before head is advanced, so records of a crashed producer are never torn.
+ */
+struct SharedLogRing {
+    std::atomic<int32_t>                ownerPid;   // 0 if free
+    std::atomic<uint64_t>               dropped;    // records failed to publish, taken by writer to report
+    alignas(64) std::atomic<uint64_t>   head;       // advanced by producer
+    alignas(64) std::atomic<uint64_t>   tail;       // advanced by writer
+};
+
+struct SharedLogHeader {
+    std::atomic<uint64_t>   magic;      // stored last by creator of segment
+    uint32_t                version;
+    uint32_t                ringNum;
+    uint64_t                ringSize;
+    std::atomic<int32_t>    writerPid;  // 0 if no writer attached
+};
+
+/**
+ * @brief POSIX shared memory segment holding one ring per producer process. The segment is created by
+ * whichever of producers and writer comes first and outlives them, so a restarted writer drains
+ * records left by crashed processes.
+ */
+class SharedLogSegment {
+public:
+    using Consumer = std::function<void(const SharedLogRecordHeader&, const char*)>;
+    using DropReporter = std::function<void(int32_t pid, uint64_t dropped)>;
+
+    ~SharedLogSegment();
+
+    bool Open(const std::string& name, uint32_t ringNum, uint64_t ringSize);
+
+    void Close();
+
+    // producer side, the ring must be published by one thread at a time
+    SharedLogRing* ClaimRing();
+
+    void ReleaseRing(SharedLogRing* ring);
+
+    bool Publish(SharedLogRing* ring, const SharedLogRecordHeader& header, const char* data, bool blocking);
+
+    // writer side
+    bool AttachWriter();
+
+    void DetachWriter();
+
+    std::size_t Drain(const Consumer& consumer);
+
+    void ReportDropped(const DropReporter& reporter);
+
+    void ReclaimRings();
+
+private:
+    static bool ProcessAlive(int32_t pid);
+    static uint64_t RecordSize(uint32_t length);
+    static uint64_t RingsOffset();
+    static uint64_t SegmentSize(uint32_t ringNum, uint64_t ringSize);
+    SharedLogRing* Ring(uint32_t index) const;
+    char* RingData(SharedLogRing* ring) const;
+    void CopyIn(SharedLogRing* ring, uint64_t position, const void* data, uint64_t length);
+    void CopyOut(SharedLogRing* ring, uint64_t position, void* data, uint64_t length) const;
+
+private:
+    SharedLogHeader*    m_header { nullptr };
+    uint64_t            m_mappedSize { 0 };
+    std::vector<char>   m_scratch;  // record wrapping around ring end is copied here
+};
+
+SharedLogSegment::~SharedLogSegment()
+{
+    Close();
+}
+
+bool SharedLogSegment::Open(const std::string& name, uint32_t ringNum, uint64_t ringSize)
+{
+    std::string shmName = (!name.empty() && name[0] == '/') ? name : "/" + name;
+    ringSize = (ringSize + SHARED_LOG_ALIGNMENT - 1) / SHARED_LOG_ALIGNMENT * SHARED_LOG_ALIGNMENT;
+    if (ringNum == 0 || ringSize == 0) {
+        return false;
+    }
+    uint64_t size = SegmentSize(ringNum, ringSize);
+    int fd = ::shm_open(shmName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+    bool creator = fd >= 0;
+    if (creator) {
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            InternalErrorLog("failed to resize shared memory %s, errno = %d", shmName.c_str(), errno);
+            ::close(fd);
+            ::shm_unlink(shmName.c_str());
+            return false;
+        }
+    } else {
+        fd = errno == EEXIST ? ::shm_open(shmName.c_str(), O_RDWR, 0) : -1;
+        if (fd < 0) {
+            InternalErrorLog("failed to open shared memory %s, errno = %d", shmName.c_str(), errno);
+            return false;
+        }
+        // wait creator to resize the segment
+        struct stat st;
+        size = 0;
+        for (uint32_t retry = 0; retry < SHARED_LOG_OPEN_RETRY_MAX && size < RingsOffset(); retry++) {
+            if (::fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_size) >= RingsOffset()) {
+                size = static_cast<uint64_t>(st.st_size);
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (size < RingsOffset()) {
+            ::close(fd);
+            return false;
+        }
+    }
+    void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        InternalErrorLog("failed to map shared memory %s, errno = %d", shmName.c_str(), errno);
+        return false;
+    }
+    m_header = static_cast<SharedLogHeader*>(addr);
+    m_mappedSize = size;
+    if (!m_header->magic.is_lock_free() || !m_header->writerPid.is_lock_free()) {
+        // atomics implemented by locks are not shared across processes
+        Close();
+        return false;
+    }
+    if (creator) {
+        new (m_header) SharedLogHeader();
+        m_header->version = SHARED_LOG_VERSION;
+        m_header->ringNum = ringNum;
+        m_header->ringSize = ringSize;
+        for (uint32_t i = 0; i < ringNum; i++) {
+            new (Ring(i)) SharedLogRing();
+        }
+        m_header->magic.store(SHARED_LOG_MAGIC, std::memory_order_release);
+        return true;
+    }
+    for (uint32_t retry = 0; retry < SHARED_LOG_OPEN_RETRY_MAX; retry++) {
+        if (m_header->magic.load(std::memory_order_acquire) == SHARED_LOG_MAGIC) {
+            if (m_header->version == SHARED_LOG_VERSION &&
+                SegmentSize(m_header->ringNum, m_header->ringSize) == m_mappedSize) {
+                return true;
+            }
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    InternalErrorLog("incompatible shared memory %s", shmName.c_str());
+    Close();
+    return false;
+}
+
+void SharedLogSegment::Close()
+{
+    if (m_header != nullptr) {
+        ::munmap(m_header, m_mappedSize);
+        m_header = nullptr;
+        m_mappedSize = 0;
+    }
+}
+
+SharedLogRing* SharedLogSegment::ClaimRing()
+{
+    int32_t pid = static_cast<int32_t>(::getpid());
+    for (uint32_t i = 0; i < m_header->ringNum; i++) {
+        int32_t expected = 0;
+        if (Ring(i)->ownerPid.compare_exchange_strong(expected, pid, std::memory_order_acq_rel)) {
+            return Ring(i);
+        }
+    }
+    InternalErrorLog("no free ring in shared memory, %u rings", m_header->ringNum);
+    return nullptr;
+}
+
+// give ring back if writer has drained it, otherwise writer reclaims it after this process exits
+void SharedLogSegment::ReleaseRing(SharedLogRing* ring)
+{
+    if (ring->head.load(std::memory_order_relaxed) == ring->tail.load(std::memory_order_acquire)) {
+        ring->ownerPid.store(0, std::memory_order_release);
+    }
+}
+
+/**
+ * @brief copy a record into ring and commit it. If ring is full, wait for writer in blocking mode
+ * as long as a writer is alive, otherwise the record is dropped. Record larger than the whole ring
+ * is always dropped. Dropped records are counted in ring and reported by writer.
+ */
+bool SharedLogSegment::Publish(
+    SharedLogRing* ring, const SharedLogRecordHeader& header, const char* data, bool blocking)
+{
+    uint64_t size = RecordSize(header.length);
+    if (size > m_header->ringSize) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    while (head + size - ring->tail.load(std::memory_order_acquire) > m_header->ringSize) {
+        int32_t writerPid = m_header->writerPid.load(std::memory_order_relaxed);
+        if (!blocking || writerPid == 0 || !ProcessAlive(writerPid)) {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(SHARED_LOG_PUBLISH_RETRY_MICROS));
+    }
+    CopyIn(ring, head, &header, sizeof(header));
+    CopyIn(ring, head + sizeof(header), data, header.length);
+    ring->head.store(head + size, std::memory_order_release);
+    return true;
+}
+
+// only one writer drains a segment, a dead writer is replaced
+bool SharedLogSegment::AttachWriter()
+{
+    int32_t pid = static_cast<int32_t>(::getpid());
+    int32_t current = m_header->writerPid.load(std::memory_order_acquire);
+    while (true) {
+        if (current != 0 && ProcessAlive(current)) {
+            InternalErrorLog("shared memory is already drained by process %d", current);
+            return false;
+        }
+        if (m_header->writerPid.compare_exchange_weak(current, pid, std::memory_order_acq_rel)) {
+            return true;
+        }
+    }
+}
+
+void SharedLogSegment::DetachWriter()
+{
+    m_header->writerPid.store(0, std::memory_order_release);
+}
+
+/**
+ * @brief consume records committed so far from all rings in timestamp order, records committed
+ * during draining are left for the next call. Return number of records consumed.
+ */
+std::size_t SharedLogSegment::Drain(const Consumer& consumer)
+{
+    struct Cursor {
+        SharedLogRing*          ring;
+        uint64_t                tail;
+        uint64_t                head;
+        SharedLogRecordHeader   header;
+    };
+    std::vector<Cursor> cursors;
+    for (uint32_t i = 0; i < m_header->ringNum; i++) {
+        Cursor cursor;
+        cursor.ring = Ring(i);
+        cursor.head = cursor.ring->head.load(std::memory_order_acquire);
+        cursor.tail = cursor.ring->tail.load(std::memory_order_relaxed);
+        if (cursor.tail != cursor.head) {
+            CopyOut(cursor.ring, cursor.tail, &cursor.header, sizeof(cursor.header));
+            cursors.push_back(cursor);
+        }
+    }
+    std::size_t drained = 0;
+    while (!cursors.empty()) {
+        auto it = std::min_element(cursors.begin(), cursors.end(), [](const Cursor& a, const Cursor& b) {
+            return a.header.timestamp < b.header.timestamp;
+        });
+        uint64_t size = RecordSize(it->header.length);
+        if (size > it->head - it->tail || it->header.level >= LOGGER_LEVEL_COUNT) {
+            // corrupted ring, skip what is committed
+            InternalErrorLog("corrupted shared memory ring, %llu bytes skipped",
+                static_cast<unsigned long long>(it->head - it->tail));
+            it->tail = it->head;
+        } else {
+            uint64_t position = (it->tail + sizeof(SharedLogRecordHeader)) % m_header->ringSize;
+            const char* data = RingData(it->ring) + position;
+            if (position + it->header.length > m_header->ringSize) {
+                m_scratch.resize(it->header.length);
+                CopyOut(it->ring, it->tail + sizeof(SharedLogRecordHeader), m_scratch.data(), it->header.length);
+                data = m_scratch.data();
+            }
+            consumer(it->header, data);
+            it->tail += size;
+            drained++;
+        }
+        it->ring->tail.store(it->tail, std::memory_order_release);
+        if (it->tail == it->head) {
+            cursors.erase(it);
+        } else {
+            CopyOut(it->ring, it->tail, &it->header, sizeof(it->header));
+        }
+    }
+    return drained;
+}
+
+// take drop counters of all rings, they are attributed to current owners
+void SharedLogSegment::ReportDropped(const DropReporter& reporter)
+{
+    for (uint32_t i = 0; i < m_header->ringNum; i++) {
+        SharedLogRing* ring = Ring(i);
+        if (ring->dropped.load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped != 0) {
+            reporter(ring->ownerPid.load(std::memory_order_relaxed), dropped);
+        }
+    }
+}
+
+// free rings of dead producers once they are drained
+void SharedLogSegment::ReclaimRings()
+{
+    for (uint32_t i = 0; i < m_header->ringNum; i++) {
+        SharedLogRing* ring = Ring(i);
+        int32_t pid = ring->ownerPid.load(std::memory_order_acquire);
+        if (pid != 0 && !ProcessAlive(pid) &&
+            ring->head.load(std::memory_order_acquire) == ring->tail.load(std::memory_order_relaxed)) {
+            ring->ownerPid.compare_exchange_strong(pid, 0, std::memory_order_acq_rel);
+        }
+    }
+}
+
+bool SharedLogSegment::ProcessAlive(int32_t pid)
+{
+    return ::kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+}
+
+uint64_t SharedLogSegment::RecordSize(uint32_t length)
+{
+    return (sizeof(SharedLogRecordHeader) + length + 7) / 8 * 8;
+}
+
+uint64_t SharedLogSegment::RingsOffset()
+{
+    return (sizeof(SharedLogHeader) + SHARED_LOG_ALIGNMENT - 1) / SHARED_LOG_ALIGNMENT * SHARED_LOG_ALIGNMENT;
+}
+
+uint64_t SharedLogSegment::SegmentSize(uint32_t ringNum, uint64_t ringSize)
+{
+    return RingsOffset() + ringNum * (sizeof(SharedLogRing) + ringSize);
+}
+
+SharedLogRing* SharedLogSegment::Ring(uint32_t index) const
+{
+    char* base = reinterpret_cast<char*>(m_header) + RingsOffset();
+    return reinterpret_cast<SharedLogRing*>(base + index * (sizeof(SharedLogRing) + m_header->ringSize));
+}
+
+char* SharedLogSegment::RingData(SharedLogRing* ring) const
+{
+    return reinterpret_cast<char*>(ring) + sizeof(SharedLogRing);
+}
+
+void SharedLogSegment::CopyIn(SharedLogRing* ring, uint64_t position, const void* data, uint64_t length)
+{
+    uint64_t offset = position % m_header->ringSize;
+    uint64_t first = std::min(length, m_header->ringSize - offset);
+    std::memcpy(RingData(ring) + offset, data, first);
+    std::memcpy(RingData(ring), static_cast<const char*>(data) + first, length - first);
+}
+
+void SharedLogSegment::CopyOut(SharedLogRing* ring, uint64_t position, void* data, uint64_t length) const
+{
+    uint64_t offset = position % m_header->ringSize;
+    uint64_t first = std::min(length, m_header->ringSize - offset);
+    std::memcpy(data, RingData(ring) + offset, first);
+    std::memcpy(static_cast<char*>(data) + first, RingData(ring), length - first);
+}
+#endif
+
+struct LogSegment {
+    const char*     data;
+    uint64_t        length;
+};
+
+/**
+ * @brief a buffer swapped out from frontend, it's swapped in again only after written to log file
+ */
+struct LogWriteBuffer {
+    char*                       data { nullptr };
+    uint64_t                    length { 0 };
+    // record larger than the whole buffer, written right after data
+    std::unique_ptr<char[]>     chain;
+    uint64_t                    chainLength { 0 };
+    uint64_t                    fileOffset { 0 };
+    uint64_t                    written { 0 };
+    bool                        done { false };
+    // swapped out and not retired yet, read by crash handler
+    std::atomic<bool>           inFlight { false };
+    // WRITE_BY_CRASH_HANDLER is never reset, consumer writes nothing after crash
+    std::atomic<uint32_t>       writeOwner { WRITE_UNCLAIMED };
+    // index entries completed before this buffer is swapped out, appended once it's written
+    std::vector<LogIndexEntry>  index;
+#ifdef MINILOGGER_HAS_IO_URING
+    struct iovec                iov[2];
+#endif
+
+    uint64_t TotalLength() const
+    {
+        return length + chainLength;
+    }
+
+    // bytes not written yet, return number of segments filled
+    uint32_t PendingSegments(LogSegment (&segments)[2]) const
+    {
+        uint32_t segmentsNum = 0;
+        if (written < length) {
+            segments[segmentsNum++] = { data + written, length - written };
+        }
+        uint64_t chainWritten = written > length ? written - length : 0;
+        if (chainWritten < chainLength) {
+            segments[segmentsNum++] = { chain.get() + chainWritten, chainLength - chainWritten };
+        }
+        return segmentsNum;
+    }
+};
+
+/**
+ * @brief opened log file and its sidecar index file
+ */
+struct LogFileHandles {
+    std::unique_ptr<std::ofstream>  file;
+    std::unique_ptr<std::ofstream>  indexFile;
+    int                             fd { -1 };  // used instead of file by io_uring backend
+    int                             crashFd { -1 }; // handed over to crash handler once it becomes current
+};
+
+/**
+ * @brief rotated log file waiting to be compressed by rotation thread
+ */
+struct ArchiveTask {
+    std::string     tempLogFilePath;
+    std::string     tempIndexFilePath;
+    std::string     archiveFilePath;
+};
+
+/**
+ * @brief buffering and output of formatted records, owns the buffers, output file and consumer thread.
+ * The root logger owns one sink, named module loggers may own dedicated sinks.
+ */
+class LoggerSink {
+public:
+    LoggerSink();
+
+    ~LoggerSink();
+
+    // calibrate tick clock in consumer thread if tickClock is not null
+    bool Init(const LoggerConfig& conf, TickClock* tickClock);
+
+    void Destroy();
+
+    void KeepRecord(const LogRecord& record, CongestionControlPolicy policy);
+
+    // async-signal-safe, write frontend and in-flight buffers to log file followed by stack trace
+    void FlushOnCrash(int signo, void* const* frames, int framesNum);
+
+private:
+    bool InitShards(TickClock* tickClock);
+    void AppendRecord(
+        const char* data, std::size_t length, LoggerLevel level, uint64_t timestamp, CongestionControlPolicy policy);
+    void EncodeRecordInPlace(const LogRecord& record, std::size_t length, CongestionControlPolicy policy);
+    void ChainRecord(std::unique_ptr<char[]> block, uint64_t length, LoggerLevel level, uint64_t timestamp,
+        CongestionControlPolicy policy);
+    void CommitRecord(uint64_t length, LoggerLevel level, uint64_t timestamp);
+    bool FrontendEmpty() const;
+    bool InitSharedLogProducer();
+    bool StartSharedLogWriter();
+    void StopSharedLogWriter();
+#ifdef MINILOGGER_HAS_SHARED_MEMORY
+    void SharedLogWriterThread();
+    void KeepSharedLogDropped(int32_t pid, uint64_t dropped);
+#endif
+    void ResetBuffer();
+    void InitIOBackend();
+    bool InitLoggerFileOutput();
+    bool OpenLogFiles(const std::string& logFilePath, LogFileHandles& handles) const;
+    static void CloseLogFiles(LogFileHandles& handles);
+    void PublishCrashFd();
+    bool InitLoggerBuffer();
+    bool StartConsumerThread();
+    void ConsumerThread();
+    bool StartRotationThread();
+    void RotationThread();
+    void PrepareNextLogFiles(LogFileHandles& handles);
+    std::string GetCurrentLogFilePath() const;
+    std::string GetCurrentIndexFilePath() const;
+    std::string GetNextLogFilePath() const;
+    void GenerateRotatedFilePaths(ArchiveTask& task) const;
+    uint64_t NextRotationTime(uint64_t now) const;
+    void SwitchToNewLogFile();
+    void ResyncFileOffsets(uint64_t fileSize);
+    void CreateArchiveFile(const ArchiveTask& task);
+    void UpdateIndexBlock(LoggerLevel level, uint64_t timestamp, uint64_t bufferOffset);
+    void CloseIndexBlock();
+    void WriteIndexEntries(std::vector<LogIndexEntry>& entries);
+    void SubmitWrite(LogWriteBuffer* buffer);
+    void WriteBufferSync(LogWriteBuffer* buffer);
+    void ReapWrites(bool wait);
+    void RetireWrites();
+    void DrainWrites();
+#ifdef MINILOGGER_HAS_IO_URING
+    bool SubmitAsyncWrite(LogWriteBuffer* buffer);
+#endif
+
+private:
+    bool                    m_inited { false };
+    LoggerConfig            m_config;
+    LogFileHandles          m_output;
+    uint64_t                m_fileSize { 0 };
+    TickClock*              m_tickClock { nullptr };
+    // sinks writing ${fileName}.N if shardNum > 1, this sink only dispatches records to them
+    std::vector<std::unique_ptr<LoggerSink>> m_shards;
+    // local time offset in seconds, the same one used to print records
+    int64_t                 m_timezoneOffset { 0 };
+    // wall-clock seconds of next time based rotation, 0 if disabled, accessed by consumer thread only
+    uint64_t                m_nextRotationTime { 0 };
+
+    std::mutex              m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    char*                   m_frontendBuffer { nullptr };
+    uint64_t                m_frontendBufferOffset { 0 };
+    // record larger than the whole buffer, follows frontend data. No record is taken until it's swapped out
+    std::unique_ptr<char[]> m_frontendChain;
+    uint64_t                m_frontendChainLength { 0 };
+
+    // buffers to swap with frontend, at most m_writeQueueDepth of them are being written at a time.
+    // accessed by consumer thread only
+    std::vector<std::unique_ptr<LogWriteBuffer>> m_writeBuffers;
+    std::vector<LogWriteBuffer*> m_freeWriteBuffers;
+    std::deque<LogWriteBuffer*> m_pendingWrites;
+    uint32_t                m_writeQueueDepth { 1 };
+    bool                    m_useFileDescriptor { false };
+#ifdef MINILOGGER_HAS_IO_URING
+    std::unique_ptr<IOUring> m_ioUring;
+#endif
+
+    // file offset where frontend buffer will be written, maintained by consumer at buffer switch
+    uint64_t                m_frontendFileOffset { 0 };
+    // frontend belongs to the next log file until it's switched in
+    std::atomic<bool>       m_rotating { false };
+    // crash handler reads frontend without lock, consumer never swaps it once m_crashing is set
+    std::atomic<bool>       m_crashing { false };
+    std::atomic<bool>       m_swapping { false };
+    // descriptor of current log file written by crash handler, replaced only after next log file is in place
+    std::atomic<int>        m_crashFd { -1 };
+    // index block may span buffers, completed entries are handed to consumer at buffer switch
+    bool                    m_indexBlockOpen { false };
+    LogIndexEntry           m_indexBlock;
+    std::vector<LogIndexEntry> m_frontendIndex;
+
+    std::thread             m_consumerThread;
+    bool                    m_abort { false };
+
+    // rotation thread prepares next log file and compresses rotated ones
+    std::thread             m_rotationThread;
+    std::mutex              m_rotationMutex;
+    std::condition_variable m_rotationCond;
+    bool                    m_nextOutputReady { false };
+    // consumer took next log file and has not renamed it yet, its path must not be prepared again until then
+    bool                    m_switchingOutput { false };
+    LogFileHandles          m_nextOutput;
+    std::deque<ArchiveTask> m_archiveTasks;
+    bool                    m_rotationAbort { false };
+
+#ifdef MINILOGGER_HAS_SHARED_MEMORY
+    // producer publishes into its own ring, writer drains all rings into frontend buffer
+    std::unique_ptr<SharedLogSegment> m_sharedLog;
+    SharedLogRing*          m_sharedLogRing { nullptr };
+    // process owning m_sharedLogRing, a forked child claims its own ring since a ring has a single producer
+    int32_t                 m_sharedLogRingOwner { 0 };
+    std::thread             m_sharedLogThread;
+    std::atomic<bool>       m_sharedLogAbort { false };
+#endif
+};
+
+class LoggerImpl;
+
+/**
+ * @brief named module logger, level and sink are resolved from the nearest configured ancestor
+ */
+class LoggerModuleImpl : public LoggerModule {
+public:
+    LoggerModuleImpl(LoggerImpl& logger, const std::string& name);
+
+    void KeepLog(
+        LoggerLevel         level,
+        const char*         function,
+        uint32_t            line,
+        const char*         message,
+        const LoggerField*  fields,
+        std::size_t         fieldsNum,
+        uint64_t            timestamp) override;
+
+    const std::string& Name() const override;
+
+private:
+    friend class LoggerImpl;
+    LoggerImpl&                 m_logger;
+    std::string                 m_name;
+    // explicit configuration of this module, guarded by LoggerImpl::m_moduleMutex
+    bool                        m_hasLevel { false };
+    LoggerLevel                 m_explicitLevel { LoggerLevel::DEBUG };
+    std::unique_ptr<LoggerSink> m_ownSink;
+    // resolved sink, nullptr to use root sink
+    std::atomic<LoggerSink*>    m_sink { nullptr };
+};
+
+/**
+ * @brief Logger implementation, used to prevent header corruption
+ */
+class LoggerImpl : public Logger {
+public:
+    LoggerImpl();
 
     // implement Logger interface
     void KeepLog(
@@ -241,322 +1921,1560 @@ public:
         const char*     message,
         uint64_t        timestamp) override;
 
+    void KeepLog(
+        LoggerLevel         level,
+        const char*         function,
+        uint32_t            line,
+        const char*         message,
+        const LoggerField*  fields,
+        std::size_t         fieldsNum,
+        uint64_t            timestamp) override;
+
     bool ShouldKeepLog(LoggerLevel level) const override;
 
     void SetLogLevel(LoggerLevel level) override;
 
     void SetThreadLocalKey(const std::string& key) override;
 
+    void SetGuardMode(LoggerGuardMode mode) override;
+
     void SetCongestionControlPolicy(CongestionControlPolicy policy) override;
 
     bool Init(const LoggerConfig& conf) override;
 
     void Destroy() override;
 
+    LoggerModule* GetModule(const std::string& name) override;
+
+    void SetModuleLogLevel(const std::string& name, LoggerLevel level) override;
+
+    void ResetModuleLogLevel(const std::string& name) override;
+
+    bool InitModuleSink(const std::string& name, const LoggerConfig& conf) override;
+
+    void KeepModuleLog(LoggerSink* sink, const char* module, const LogRecord& record);
+
+    LoggerSink* RootSink();
+
     ~LoggerImpl();
 
 private:
-    void ResetBuffer();
-    bool InitLoggerFileOutput();
-    bool InitLoggerBuffer();
-    bool StartConsumerThread();
-    void ConsumerThread();
-    std::string GetCurrentLogFilePath() const;
-    std::string GenerateTempLogFilePath() const;
-    std::string GenerateArchiveFilePath() const;
-    void SwitchToNewLogFile();
-    void AsyncCreateArchiveFile(const std::string& tempLogFilePath, const std::string& archiveFilePath);
+    LoggerModuleImpl* GetOrCreateModule(const std::string& name);
+    void ResolveModules();
 
 private:
-    LoggerLevel             m_level { LoggerLevel::DEBUG };
+    std::atomic<LoggerLevel> m_level { LoggerLevel::DEBUG };
     CongestionControlPolicy m_congestionPolicy { CongestionControlPolicy::BLOCKING };
     bool                    m_inited { false };
-    LoggerConfig            m_config;
-    std::ofstream           m_file;
+    bool                    m_stdout { true };
     uint64_t                m_timezoneTimestampOffset { 0 }; // timestamp timezone offset in seconds
+    bool                    m_useTickClock { false };
+    TickClock               m_tickClock;
+    LoggerSink              m_sink;
 
-    std::mutex              m_mutex;
-    std::condition_variable m_notFull;
-    std::condition_variable m_notEmpty;
-    char*                   m_frontendBuffer { nullptr };
-    char*                   m_backendBuffer { nullptr };
+    std::mutex              m_moduleMutex;
+    std::map<std::string, std::unique_ptr<LoggerModuleImpl>> m_modules;
+};
 
-    uint64_t                m_frontendBufferOffset { 0 };
-    uint64_t                m_backendBufferOffset { 0 };
+// singleton instance using eager mode
+static LoggerImpl instance;
 
-    std::thread             m_consumerThread;
-    bool                    m_abort { false };
-};
+Logger* Logger::GetInstance()
+{
+    return dynamic_cast<Logger*>(&instance);
+}
+
+Logger::~Logger()
+{}
+
+LoggerModule::~LoggerModule()
+{}
+
+// implement LoggerImpl from here
+void LoggerImpl::SetLogLevel(LoggerLevel level)
+{
+    m_level = level;
+    // modules without explicit level inherit from root
+    ResolveModules();
+}
+
+void LoggerImpl::SetThreadLocalKey(const std::string& key)
+{
+    SetThreadContextKey(key);
+}
+
+void LoggerImpl::SetGuardMode(LoggerGuardMode mode)
+{
+    g_guardMode.store(static_cast<int>(mode), std::memory_order_relaxed);
+}
+
+void LoggerImpl::SetCongestionControlPolicy(CongestionControlPolicy policy)
+{
+    m_congestionPolicy = policy;
+}
+
+bool LoggerImpl::ShouldKeepLog(LoggerLevel level) const
+{
+    return m_level.load(std::memory_order_relaxed) <= level;
+}
+
+void LoggerImpl::Destroy()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_moduleMutex);
+        for (auto& module : m_modules) {
+            if (module.second->m_ownSink) {
+                module.second->m_ownSink->Destroy();
+            }
+        }
+    }
+    m_sink.Destroy();
+    if (m_useTickClock) {
+        g_useTickClock.store(false, std::memory_order_release);
+        m_useTickClock = false;
+    }
+}
+
+LoggerImpl::LoggerImpl()
+{}
+
+LoggerImpl::~LoggerImpl()
+{
+    Destroy();
+}
+
+void LoggerImpl::KeepLog(
+    LoggerLevel     level,
+    const char*     function,
+    uint32_t        line,
+    const char*     message,
+    uint64_t        timestamp)
+{
+    KeepLog(level, function, line, message, nullptr, 0, timestamp);
+}
+
+void LoggerImpl::KeepLog(
+    LoggerLevel         level,
+    const char*         function,
+    uint32_t            line,
+    const char*         message,
+    const LoggerField*  fields,
+    std::size_t         fieldsNum,
+    uint64_t            timestamp)
+{
+    // timezone, thread context and module are completed by KeepModuleLog()
+    LogRecord record { level, function, line, message, fields, fieldsNum, timestamp, 0, nullptr, nullptr, 0 };
+    KeepModuleLog(&m_sink, nullptr, record);
+}
+
+LoggerSink* LoggerImpl::RootSink()
+{
+    return &m_sink;
+}
+
+void LoggerImpl::KeepModuleLog(LoggerSink* sink, const char* module, const LogRecord& record)
+{
+    if (!m_inited && !m_stdout) {
+        return;
+    }
+    LogRecord completeRecord = record;
+    if ((record.timestamp & TICK_TIMESTAMP_FLAG) != 0) {
+        // tick clock is initialized before any tagged timestamp is read, and kept after Destroy()
+        completeRecord.timestamp = m_tickClock.ToMicroseconds(record.timestamp & ~TICK_TIMESTAMP_FLAG);
+    }
+    completeRecord.timezoneOffset = m_timezoneTimestampOffset;
+    completeRecord.context = &GetThreadContext();
+    completeRecord.module = module;
+    sink->KeepRecord(completeRecord, m_congestionPolicy);
+}
+
+bool LoggerImpl::Init(const LoggerConfig& conf)
+{
+    if (m_inited) {
+        return true;
+    }
+    m_timezoneTimestampOffset = GetCurrentTimezoneOffset() * 60 * 60;
+    m_stdout = conf.target == LoggerTarget::STDOUT;
+    if (conf.target == LoggerTarget::FILE && conf.clockSource == ClockSource::TSC) {
+        m_tickClock.Init();
+        m_useTickClock = true;
+    }
+    m_inited = m_sink.Init(conf, m_useTickClock ? &m_tickClock : nullptr);
+    if (!m_inited) {
+        m_useTickClock = false;
+    }
+    // published after tick clock is initialized
+    g_useTickClock.store(m_useTickClock, std::memory_order_release);
+    return m_inited;
+}
+
+LoggerModuleImpl* LoggerImpl::GetOrCreateModule(const std::string& name)
+{
+    auto it = m_modules.find(name);
+    if (it != m_modules.end()) {
+        return it->second.get();
+    }
+    LoggerModuleImpl* module = new LoggerModuleImpl(*this, name);
+    m_modules[name].reset(module);
+    return module;
+}
+
+/**
+ * @brief recompute effective level and sink of every module, walk "a.b.c" -> "a.b" -> "a" -> root
+ * until an explicit configuration is found
+ */
+void LoggerImpl::ResolveModules()
+{
+    std::lock_guard<std::mutex> lk(m_moduleMutex);
+    for (auto& entry : m_modules) {
+        LoggerModuleImpl* module = entry.second.get();
+        bool levelResolved = false;
+        bool sinkResolved = false;
+        LoggerLevel level = m_level.load(std::memory_order_relaxed);
+        LoggerSink* sink = nullptr;
+        std::string name = module->m_name;
+        while (!(levelResolved && sinkResolved)) {
+            auto it = m_modules.find(name);
+            if (it != m_modules.end()) {
+                if (!levelResolved && it->second->m_hasLevel) {
+                    level = it->second->m_explicitLevel;
+                    levelResolved = true;
+                }
+                if (!sinkResolved && it->second->m_ownSink) {
+                    sink = it->second->m_ownSink.get();
+                    sinkResolved = true;
+                }
+            }
+            std::size_t pos = name.rfind('.');
+            if (pos == std::string::npos) {
+                break;
+            }
+            name.resize(pos);
+        }
+        module->m_level.store(static_cast<int>(level), std::memory_order_relaxed);
+        module->m_sink.store(sink, std::memory_order_release);
+    }
+}
+
+LoggerModule* LoggerImpl::GetModule(const std::string& name)
+{
+    LoggerModuleImpl* module = nullptr;
+    {
+        std::lock_guard<std::mutex> lk(m_moduleMutex);
+        auto it = m_modules.find(name);
+        if (it != m_modules.end()) {
+            return it->second.get();
+        }
+        module = GetOrCreateModule(name);
+    }
+    ResolveModules();
+    return module;
+}
+
+void LoggerImpl::SetModuleLogLevel(const std::string& name, LoggerLevel level)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_moduleMutex);
+        LoggerModuleImpl* module = GetOrCreateModule(name);
+        module->m_hasLevel = true;
+        module->m_explicitLevel = level;
+    }
+    ResolveModules();
+}
+
+void LoggerImpl::ResetModuleLogLevel(const std::string& name)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_moduleMutex);
+        auto it = m_modules.find(name);
+        if (it == m_modules.end()) {
+            return;
+        }
+        it->second->m_hasLevel = false;
+    }
+    ResolveModules();
+}
+
+bool LoggerImpl::InitModuleSink(const std::string& name, const LoggerConfig& conf)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_moduleMutex);
+        LoggerModuleImpl* module = GetOrCreateModule(name);
+        if (module->m_ownSink) {
+            return false;
+        }
+        std::unique_ptr<LoggerSink> sink(new LoggerSink());
+        if (!sink->Init(conf, nullptr)) {
+            return false;
+        }
+        module->m_ownSink = std::move(sink);
+    }
+    ResolveModules();
+    return true;
+}
+
+// implement LoggerModuleImpl from here
+LoggerModuleImpl::LoggerModuleImpl(LoggerImpl& logger, const std::string& name)
+    : m_logger(logger), m_name(name)
+{}
+
+const std::string& LoggerModuleImpl::Name() const
+{
+    return m_name;
+}
+
+void LoggerModuleImpl::KeepLog(
+    LoggerLevel         level,
+    const char*         function,
+    uint32_t            line,
+    const char*         message,
+    const LoggerField*  fields,
+    std::size_t         fieldsNum,
+    uint64_t            timestamp)
+{
+    LoggerSink* sink = m_sink.load(std::memory_order_acquire);
+    LogRecord record { level, function, line, message, fields, fieldsNum, timestamp, 0, nullptr, nullptr, 0 };
+    // module without sink of its own or its ancestors still names itself in root sink
+    m_logger.KeepModuleLog(sink != nullptr ? sink : m_logger.RootSink(), m_name.c_str(), record);
+}
 
-// singleton instance using eager mode
-static LoggerImpl instance;
+#ifdef MINILOGGER_HAS_CRASH_HANDLER
+namespace {
+    const int CRASH_SIGNALS[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+    const std::size_t CRASH_SIGNAL_NUM = sizeof(CRASH_SIGNALS) / sizeof(CRASH_SIGNALS[0]);
 
-const char* g_loggerLevelStr[LOGGER_LEVEL_COUNT] = {
-    "DBG",
-    "INFO",
-    "WARN",
-    "ERR",
-    "FATAL"
-};
+    std::atomic<LoggerSink*> g_crashSinks[CRASH_SINK_NUM_MAX];
+    struct sigaction g_previousActions[CRASH_SIGNAL_NUM];
+    std::once_flag g_crashHandlerInstalled;
+    std::atomic<bool> g_crashing { false };
+}
 
-thread_local std::string g_threadLocalKey;
+/**
+ * @brief flush registered sinks once, then hand the signal to the handler installed before minilogger,
+ * default action is restored and signal is raised again to terminate the process
+ */
+static void CrashSignalHandler(int signo, siginfo_t* info, void* context)
+{
+    int savedErrno = errno;
+    if (!g_crashing.exchange(true)) {
+        void* frames[CRASH_BACKTRACE_DEPTH_MAX];
+        int framesNum = ::backtrace(frames, CRASH_BACKTRACE_DEPTH_MAX);
+        for (std::atomic<LoggerSink*>& slot : g_crashSinks) {
+            LoggerSink* sink = slot.load(std::memory_order_acquire);
+            if (sink != nullptr) {
+                sink->FlushOnCrash(signo, frames, framesNum);
+            }
+        }
+    }
+    errno = savedErrno;
+    std::size_t index = 0;
+    while (index < CRASH_SIGNAL_NUM && CRASH_SIGNALS[index] != signo) {
+        index++;
+    }
+    if (index == CRASH_SIGNAL_NUM) {
+        return;
+    }
+    const struct sigaction& previous = g_previousActions[index];
+    if ((previous.sa_flags & SA_SIGINFO) != 0 && previous.sa_sigaction != nullptr) {
+        previous.sa_sigaction(signo, info, context);
+        return;
+    }
+    if ((previous.sa_flags & SA_SIGINFO) == 0 && previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+        previous.sa_handler(signo);
+        return;
+    }
+    ::sigaction(signo, &previous, nullptr);
+    ::raise(signo);
+}
 
-Logger* Logger::GetInstance()
+static void InstallCrashHandlers()
 {
-    return dynamic_cast<Logger*>(&instance);
+    // backtrace() loads its unwinder lazily, which is not safe inside signal handler
+    void* frame = nullptr;
+    ::backtrace(&frame, 1);
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_sigaction = CrashSignalHandler;
+    // runs on alternate signal stack of crashing thread if it has one, see SetupCrashSignalStack()
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    for (std::size_t i = 0; i < CRASH_SIGNAL_NUM; i++) {
+        ::sigaction(CRASH_SIGNALS[i], &action, &g_previousActions[i]);
+    }
+    g_crashHandlerActive.store(true, std::memory_order_relaxed);
 }
 
-Logger::~Logger()
-{}
+static bool RegisterCrashSink(LoggerSink* sink)
+{
+    std::call_once(g_crashHandlerInstalled, InstallCrashHandlers);
+    SetupCrashSignalStack();
+    for (std::atomic<LoggerSink*>& slot : g_crashSinks) {
+        LoggerSink* expected = nullptr;
+        if (slot.compare_exchange_strong(expected, sink, std::memory_order_acq_rel)) {
+            return true;
+        }
+    }
+    return false;
+}
 
-// implement LoggerImpl from here
-void LoggerImpl::SetLogLevel(LoggerLevel level)
+static void UnregisterCrashSink(LoggerSink* sink)
 {
-    m_level = level;
+    for (std::atomic<LoggerSink*>& slot : g_crashSinks) {
+        LoggerSink* expected = sink;
+        slot.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel);
+    }
 }
 
-void LoggerImpl::SetThreadLocalKey(const std::string& key)
+static void WriteAllAt(int fd, const char* data, uint64_t length, uint64_t offset)
 {
-    g_threadLocalKey = key;
+    while (length > 0) {
+        ssize_t ret = ::pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return;
+        }
+        data += ret;
+        length -= static_cast<uint64_t>(ret);
+        offset += static_cast<uint64_t>(ret);
+    }
 }
+#endif
 
-void LoggerImpl::SetCongestionControlPolicy(CongestionControlPolicy policy)
+/**
+ * @brief consumer is stopped from swapping frontend, and every buffer it has not started writing is
+ * claimed, so that each record is written exactly once. Writes consumer has started are waited for.
+ * Claimed buffers are written at their own file offsets, stack trace is appended after the last record.
+ */
+void LoggerSink::FlushOnCrash(int signo, void* const* frames, int framesNum)
 {
-    m_congestionPolicy = policy;
+#ifdef MINILOGGER_HAS_CRASH_HANDLER
+    struct timespec interval { 0, 1000000 };
+    m_crashing.store(true, std::memory_order_seq_cst);
+    // log file switch is waited for as well, so that records are written into the file they belong to
+    for (uint32_t i = 0; i < CRASH_FLUSH_WAIT_MILLIS &&
+        (m_swapping.load(std::memory_order_seq_cst) || m_rotating.load(std::memory_order_seq_cst)); i++) {
+        ::nanosleep(&interval, nullptr);
+    }
+    // consumer never closes the descriptor loaded here once m_crashing is set
+    int fd = m_crashFd.load(std::memory_order_seq_cst);
+    if (fd < 0) {
+        return;
+    }
+    for (const std::unique_ptr<LogWriteBuffer>& buffer : m_writeBuffers) {
+        uint32_t owner = WRITE_UNCLAIMED;
+        if (buffer->writeOwner.compare_exchange_strong(owner, WRITE_BY_CRASH_HANDLER, std::memory_order_acq_rel)) {
+            continue;
+        }
+        for (uint32_t i = 0; i < CRASH_FLUSH_WAIT_MILLIS && owner == WRITE_BY_CONSUMER; i++) {
+            ::nanosleep(&interval, nullptr);
+            owner = buffer->writeOwner.load(std::memory_order_acquire);
+        }
+        if (owner == WRITE_BY_CONSUMER) {
+            // consumer never finishes, most likely it's the crashing thread. Rewrite at the same offset
+            WriteAllAt(fd, buffer->data, buffer->length, buffer->fileOffset);
+            WriteAllAt(fd, buffer->chain.get(), buffer->chainLength, buffer->fileOffset + buffer->length);
+        }
+    }
+    uint64_t end = 0;
+    struct stat st;
+    if (::fstat(fd, &st) == 0) {
+        end = static_cast<uint64_t>(st.st_size);
+    }
+    for (const std::unique_ptr<LogWriteBuffer>& buffer : m_writeBuffers) {
+        if (buffer->inFlight.load(std::memory_order_acquire) &&
+            buffer->writeOwner.load(std::memory_order_acquire) == WRITE_BY_CRASH_HANDLER) {
+            WriteAllAt(fd, buffer->data, buffer->length, buffer->fileOffset);
+            WriteAllAt(fd, buffer->chain.get(), buffer->chainLength, buffer->fileOffset + buffer->length);
+            end = std::max(end, buffer->fileOffset + buffer->TotalLength());
+        }
+    }
+    const char* frontend = m_frontendBuffer;
+    uint64_t frontendLength = m_frontendBufferOffset;
+    const char* chain = m_frontendChain.get();
+    uint64_t chainLength = chain == nullptr ? 0 : m_frontendChainLength;
+    if (frontend != nullptr && frontendLength + chainLength != 0 && frontendLength <= m_config.bufferSize) {
+        uint64_t offset = m_rotating.load(std::memory_order_acquire) ? end : m_frontendFileOffset;
+        WriteAllAt(fd, frontend, frontendLength, offset);
+        WriteAllAt(fd, chain, chainLength, offset + frontendLength);
+        end = std::max(end, offset + frontendLength + chainLength);
+    }
+    char banner[64] = "*** minilogger caught signal ";
+    std::size_t length = std::strlen(banner);
+    char digits[16];
+    std::size_t digitsNum = 0;
+    for (unsigned value = static_cast<unsigned>(signo); digitsNum == 0 || value != 0; value /= 10) {
+        digits[digitsNum++] = static_cast<char>('0' + value % 10);
+    }
+    while (digitsNum > 0) {
+        banner[length++] = digits[--digitsNum];
+    }
+    const char suffix[] = ", stack trace: ***\n";
+    std::memcpy(banner + length, suffix, sizeof(suffix) - 1);
+    length += sizeof(suffix) - 1;
+    WriteAllAt(fd, banner, length, end);
+    if (::lseek(fd, static_cast<off_t>(end + length), SEEK_SET) >= 0) {
+        ::backtrace_symbols_fd(frames, framesNum, fd);
+    }
+#else
+    (void)signo;
+    (void)frames;
+    (void)framesNum;
+#endif
 }
 
-bool LoggerImpl::ShouldKeepLog(LoggerLevel level) const
+// implement LoggerSink from here
+LoggerSink::LoggerSink()
+{}
+
+LoggerSink::~LoggerSink()
 {
-    return m_level <= level;
+    Destroy();
 }
 
-void LoggerImpl::Destroy()
+bool LoggerSink::Init(const LoggerConfig& conf, TickClock* tickClock)
+{
+    if (m_inited) {
+        return true;
+    }
+    m_config = conf;
+    m_tickClock = tickClock;
+    if (m_config.target == LoggerTarget::FILE && m_config.shardNum > 1) {
+        m_inited = InitShards(tickClock);
+    } else if (m_config.target == LoggerTarget::FILE) {
+        m_timezoneOffset = static_cast<int64_t>(GetCurrentTimezoneOffset()) * 60 * 60;
+        InitIOBackend();
+        if (InitLoggerFileOutput() &&
+            InitLoggerBuffer() &&
+            StartRotationThread() &&
+            StartConsumerThread() &&
+            StartSharedLogWriter()) {
+            m_inited = true;
+        } else {
+            m_inited = false;
+        }
+        if (m_inited && m_config.crashHandler) {
+#ifdef MINILOGGER_HAS_CRASH_HANDLER
+            // crash handling is asked for explicitly, a sink which would not be flushed on crash is rejected
+            if (!RegisterCrashSink(this)) {
+                InternalErrorLog("crash handler flushes at most %zu sinks", CRASH_SINK_NUM_MAX);
+                Destroy();
+                m_inited = false;
+            }
+#else
+            InternalErrorLog("crash handler is not supported on this platform");
+#endif
+        }
+    } else if (m_config.target == LoggerTarget::SHARED_MEMORY) {
+        m_inited = InitSharedLogProducer();
+    } else {
+        m_inited = true;
+    }
+    return m_inited;
+}
+
+void LoggerSink::Destroy()
 {
+#ifdef MINILOGGER_HAS_CRASH_HANDLER
+    UnregisterCrashSink(this);
+#endif
+    // records published by other processes are drained before consumer stops
+    StopSharedLogWriter();
     // to stop consumer thread
-    m_abort = true;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_abort = true;
+    }
+    m_notFull.notify_all();
     m_notEmpty.notify_one();
     if (m_consumerThread.joinable()) {
         m_consumerThread.join();
     }
+    // rotation thread exits after rotated files are compressed
+    {
+        std::lock_guard<std::mutex> lk(m_rotationMutex);
+        m_rotationAbort = true;
+    }
+    m_rotationCond.notify_one();
+    if (m_rotationThread.joinable()) {
+        m_rotationThread.join();
+    }
     ResetBuffer();
+    PublishCrashFd();
+    CloseLogFiles(m_output);
+    for (std::unique_ptr<LoggerSink>& shard : m_shards) {
+        shard->Destroy();
+    }
+}
+
+/**
+ * @brief create shardNum file sinks, each owns buffers, consumer thread, log files and archives
+ * of its own. Records of a thread always go to the same shard.
+ */
+bool LoggerSink::InitShards(TickClock* tickClock)
+{
+    for (uint32_t i = 0; i < m_config.shardNum; i++) {
+        LoggerConfig conf = m_config;
+        conf.shardNum = 1;
+        conf.fileName += "." + std::to_string(i);
+        conf.archiveFileName += "." + std::to_string(i);
+        // records of other processes are drained by the first shard, tick clock is calibrated by it too
+        if (i != 0) {
+            conf.shmName.clear();
+        }
+        std::unique_ptr<LoggerSink> shard(new LoggerSink());
+        if (!shard->Init(conf, i == 0 ? tickClock : nullptr)) {
+            m_shards.clear();
+            return false;
+        }
+        m_shards.push_back(std::move(shard));
+    }
+    return true;
 }
 
-void LoggerImpl::ResetBuffer()
+void LoggerSink::ResetBuffer()
 {
     if (m_frontendBuffer != nullptr) {
         delete[] m_frontendBuffer;
         m_frontendBuffer = nullptr;
     }
-    if (m_backendBuffer == nullptr) {
-        delete[] m_backendBuffer;
-        m_backendBuffer = nullptr;
+    m_frontendChain.reset();
+    m_frontendChainLength = 0;
+    for (std::unique_ptr<LogWriteBuffer>& buffer : m_writeBuffers) {
+        delete[] buffer->data;
     }
+    m_writeBuffers.clear();
+    m_freeWriteBuffers.clear();
+    m_pendingWrites.clear();
 }
 
-LoggerImpl::LoggerImpl()
-{}
-
-LoggerImpl::~LoggerImpl()
+/**
+ * @brief select how buffers are written, IO_URING falls back to blocking write if not supported
+ */
+void LoggerSink::InitIOBackend()
 {
-    Destroy();
+    m_writeQueueDepth = 1;
+#ifdef MINILOGGER_HAS_IO_URING
+    if (m_config.ioBackend == LoggerIOBackend::IO_URING && m_config.writeQueueDepth != 0) {
+        std::unique_ptr<IOUring> ioUring(new IOUring());
+        if (ioUring->Init(m_config.writeQueueDepth)) {
+            m_ioUring = std::move(ioUring);
+            m_writeQueueDepth = m_config.writeQueueDepth;
+            m_useFileDescriptor = true;
+            return;
+        }
+    }
+#endif
+    if (m_config.ioBackend == LoggerIOBackend::IO_URING) {
+        InternalErrorLog("io_uring not available, fallback to blocking write");
+    }
 }
 
-void LoggerImpl::KeepLog(
-    LoggerLevel     level,
-    const char*     function,
-    uint32_t        line,
-    const char*     message,
-    uint64_t        timestamp)
+void LoggerSink::KeepRecord(const LogRecord& record, CongestionControlPolicy policy)
 {
     if ((!m_inited && m_config.target != LoggerTarget::STDOUT) || m_abort) {
         return;
     }
-    char bufferLocal[LOGGER_BUFFER_DEFAULT_LEN] = { '\0' };
-    char* bufferEx = nullptr;
+    if (!m_shards.empty()) {
+        uint32_t sequence = record.context == nullptr ? 0 : record.context->sequence;
+        m_shards[sequence % m_shards.size()]->KeepRecord(record, policy);
+        return;
+    }
+    const LogRecord* encoded = &record;
+#ifdef MINILOGGER_HAS_SHARED_MEMORY
+    // records of all processes are merged by writer, tag them with producer process
+    LogRecord sharedRecord;
+    if (m_config.target == LoggerTarget::SHARED_MEMORY) {
+        sharedRecord = record;
+        sharedRecord.pid = g_processID.load(std::memory_order_relaxed);
+        encoded = &sharedRecord;
+    }
+#endif
+    char bufferLocal[LOGGER_BUFFER_DEFAULT_LEN];
+    std::unique_ptr<char[]> bufferEx;
     char* buffer = bufferLocal;
-    static std::hash<std::thread::id> ThreadIDHasher;
-    uint64_t threadID = ThreadIDHasher(std::this_thread::get_id());
-    std::string datetime = ParseDateTimeFromSeconds(timestamp / 1000000, m_timezoneTimestampOffset);
-    uint32_t microSeconds = static_cast<uint32_t>(timestamp % 1000000);
-    const char* levelStr = g_loggerLevelStr[static_cast<uint32_t>(level)];
-    std::string prettyFunction = FormatFunction(function);
-    int length = ::snprintf(buffer, LOGGER_BUFFER_DEFAULT_LEN, LOG_FORMAT_STR,
-            datetime.c_str(), microSeconds, levelStr, message, prettyFunction.c_str(), line, threadID, g_threadLocalKey.c_str());
+    // length of large payload is counted without encoding, it's encoded only once where it fits
+    bool countOnly = RecordPayloadLength(record) >= LOGGER_MESSAGE_BUFFER_MAX_LEN;
+    std::size_t length = countOnly ? EncodeRecord(m_config.format, nullptr, 0, *encoded) :
+        EncodeRecord(m_config.format, buffer, LOGGER_BUFFER_DEFAULT_LEN, *encoded);
+    if ((countOnly || length >= LOGGER_BUFFER_DEFAULT_LEN) && m_config.target == LoggerTarget::FILE) {
+        // right into frontend buffer
+        EncodeRecordInPlace(record, length, policy);
+        return;
+    }
     if (length >= LOGGER_BUFFER_DEFAULT_LEN) {
         // truncated buffer other wise
-        bufferEx = new char[length + 1];
-        memset(bufferEx, 0, sizeof(char) * (length + 1));
-        buffer = bufferEx;
-        ::snprintf(bufferEx, length + 1, LOG_FORMAT_STR,
-            datetime.c_str(), microSeconds, levelStr, message, prettyFunction.c_str(), line, threadID, g_threadLocalKey.c_str());
+        bufferEx.reset(new char[length + 1]);
+        buffer = bufferEx.get();
+        countOnly = true;
+    }
+    if (countOnly) {
+        EncodeRecord(m_config.format, buffer, length + 1, *encoded);
     }
     if (m_config.target == LoggerTarget::STDOUT) {
         // do not buffering for stdout output
-        printf("%s", buffer);
+        ::fwrite(buffer, 1, length, stdout);
+#ifdef MINILOGGER_HAS_SHARED_MEMORY
+    } else if (m_config.target == LoggerTarget::SHARED_MEMORY) {
+        SharedLogRecordHeader header { static_cast<uint32_t>(length), static_cast<uint32_t>(record.level), record.timestamp };
+        std::lock_guard<std::mutex> lk(m_mutex);
+        if (!m_abort && m_sharedLogRingOwner != encoded->pid) {
+            m_sharedLogRing = m_sharedLog->ClaimRing();
+            m_sharedLogRingOwner = encoded->pid;
+        }
+        if (!m_abort && m_sharedLogRing != nullptr) {
+            m_sharedLog->Publish(m_sharedLogRing, header, buffer, policy == CongestionControlPolicy::BLOCKING);
+        }
+#endif
     } else {
-        std::unique_lock<std::mutex> lk(m_mutex);
-        // lock thread util frontendBufferOffset + length < bufferSize
-        if (m_frontendBufferOffset + length >= m_config.bufferSize &&
-            m_congestionPolicy == CongestionControlPolicy::DROPPING) {
-            // dropping policy take effect here, current log will be dropped
-            return;
+        AppendRecord(buffer, length, record.level, record.timestamp, policy);
+    }
+}
+
+// copy encoded record into frontend buffer
+void LoggerSink::AppendRecord(
+    const char* data, std::size_t length, LoggerLevel level, uint64_t timestamp, CongestionControlPolicy policy)
+{
+    if (length >= m_config.bufferSize) {
+        // never fits in frontend buffer
+        std::unique_ptr<char[]> block(new char[length]);
+        std::memcpy(block.get(), data, length);
+        ChainRecord(std::move(block), length, level, timestamp, policy);
+        return;
+    }
+    std::unique_lock<std::mutex> lk(m_mutex);
+    // lock thread util frontendBufferOffset + length < bufferSize
+    if ((m_frontendChain || m_frontendBufferOffset + length >= m_config.bufferSize) &&
+        policy == CongestionControlPolicy::DROPPING) {
+        // dropping policy take effect here, current log will be dropped
+        return;
+    }
+    m_notFull.wait(lk, [&]() {
+        return m_abort || (!m_frontendChain && m_frontendBufferOffset + length < m_config.bufferSize);
+    });
+    if (m_abort) {
+        return;
+    }
+    // write n bytes to frontendBuffer from offset
+    memcpy(m_frontendBuffer + m_frontendBufferOffset, data, length);
+    CommitRecord(length, level, timestamp);
+}
+
+/**
+ * @brief encode record of known length into free space of frontend buffer, waiting for space like AppendRecord.
+ * A record larger than the whole buffer is encoded into a block of its exact size without lock and chained.
+ */
+void LoggerSink::EncodeRecordInPlace(const LogRecord& record, std::size_t length, CongestionControlPolicy policy)
+{
+    if (length >= m_config.bufferSize) {
+        std::unique_ptr<char[]> block(new char[length + 1]);
+        EncodeRecord(m_config.format, block.get(), length + 1, record);
+        ChainRecord(std::move(block), length, record.level, record.timestamp, policy);
+        return;
+    }
+    std::unique_lock<std::mutex> lk(m_mutex);
+    auto hasSpace = [&]() {
+        return !m_frontendChain && m_frontendBufferOffset + length < m_config.bufferSize;
+    };
+    if (!hasSpace() && policy == CongestionControlPolicy::DROPPING) {
+        return;
+    }
+    m_notFull.wait(lk, [&]() { return m_abort || hasSpace(); });
+    if (m_abort) {
+        return;
+    }
+    EncodeRecord(m_config.format, m_frontendBuffer + m_frontendBufferOffset,
+        m_config.bufferSize - m_frontendBufferOffset, record);
+    CommitRecord(length, record.level, record.timestamp);
+}
+
+/**
+ * @brief hand a record larger than the whole buffer to consumer as it is, it's written right after
+ * records already in frontend buffer
+ */
+void LoggerSink::ChainRecord(std::unique_ptr<char[]> block, uint64_t length, LoggerLevel level, uint64_t timestamp,
+    CongestionControlPolicy policy)
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+    if (m_frontendChain && policy == CongestionControlPolicy::DROPPING) {
+        return;
+    }
+    m_notFull.wait(lk, [&]() { return m_abort || !m_frontendChain; });
+    if (m_abort) {
+        return;
+    }
+    if (m_config.indexInterval != 0) {
+        UpdateIndexBlock(level, timestamp, m_frontendBufferOffset);
+    }
+    m_frontendChain = std::move(block);
+    m_frontendChainLength = length;
+    m_notEmpty.notify_one();
+}
+
+// account a record written at frontend buffer offset, must be called with m_mutex held
+void LoggerSink::CommitRecord(uint64_t length, LoggerLevel level, uint64_t timestamp)
+{
+    if (m_config.indexInterval != 0) {
+        UpdateIndexBlock(level, timestamp, m_frontendBufferOffset);
+    }
+    m_frontendBufferOffset += length;
+    m_notEmpty.notify_one();
+}
+
+// must be called with m_mutex held
+bool LoggerSink::FrontendEmpty() const
+{
+    return m_frontendBufferOffset == 0 && !m_frontendChain;
+}
+
+/**
+ * @brief attach to shared memory segment and claim a ring for this process
+ */
+bool LoggerSink::InitSharedLogProducer()
+{
+#ifdef MINILOGGER_HAS_SHARED_MEMORY
+    std::unique_ptr<SharedLogSegment> segment(new SharedLogSegment());
+    if (m_config.shmName.empty() || !segment->Open(m_config.shmName, m_config.shmRingNum, m_config.shmRingSize)) {
+        return false;
+    }
+    m_sharedLogRing = segment->ClaimRing();
+    if (m_sharedLogRing == nullptr) {
+        return false;
+    }
+    m_sharedLogRingOwner = g_processID.load(std::memory_order_relaxed);
+    m_sharedLog = std::move(segment);
+    return true;
+#else
+    InternalErrorLog("shared memory target is not supported on this platform");
+    return false;
+#endif
+}
+
+/**
+ * @brief drain records published by other processes into this file sink if shmName is set
+ */
+bool LoggerSink::StartSharedLogWriter()
+{
+    if (m_config.shmName.empty()) {
+        return true;
+    }
+#ifdef MINILOGGER_HAS_SHARED_MEMORY
+    std::unique_ptr<SharedLogSegment> segment(new SharedLogSegment());
+    if (!segment->Open(m_config.shmName, m_config.shmRingNum, m_config.shmRingSize)) {
+        return false;
+    }
+    if (!segment->AttachWriter()) {
+        return false;
+    }
+    m_sharedLog = std::move(segment);
+    m_sharedLogAbort.store(false, std::memory_order_relaxed);
+    try {
+        m_sharedLogThread = std::thread(&LoggerSink::SharedLogWriterThread, this);
+    } catch (const std::system_error& e) {
+        m_sharedLog->DetachWriter();
+        m_sharedLog.reset();
+        return false;
+    }
+    return true;
+#else
+    InternalErrorLog("shared memory is not supported on this platform");
+    return false;
+#endif
+}
+
+void LoggerSink::StopSharedLogWriter()
+{
+#ifdef MINILOGGER_HAS_SHARED_MEMORY
+    m_sharedLogAbort.store(true, std::memory_order_release);
+    if (m_sharedLogThread.joinable()) {
+        m_sharedLogThread.join();
+        m_sharedLog->DetachWriter();
+    }
+    if (m_sharedLog && m_sharedLogRing != nullptr) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_abort = true;
+        m_sharedLog->ReleaseRing(m_sharedLogRing);
+        m_sharedLogRing = nullptr;
+    }
+    m_sharedLog.reset();
+#endif
+}
+
+#ifdef MINILOGGER_HAS_SHARED_MEMORY
+/**
+ * @brief poll rings of all producer processes, a final pass is taken after abort
+ * so that records published before Destroy() are kept
+ */
+void LoggerSink::SharedLogWriterThread()
+{
+    SharedLogSegment::Consumer consumer = [this](const SharedLogRecordHeader& header, const char* data) {
+        AppendRecord(data, header.length, static_cast<LoggerLevel>(header.level), header.timestamp,
+            CongestionControlPolicy::BLOCKING);
+    };
+    SharedLogSegment::DropReporter reporter = [this](int32_t pid, uint64_t dropped) {
+        KeepSharedLogDropped(pid, dropped);
+    };
+    auto lastReclaim = std::chrono::steady_clock::now();
+    while (true) {
+        bool abort = m_sharedLogAbort.load(std::memory_order_acquire);
+        std::size_t drained = m_sharedLog->Drain(consumer);
+        m_sharedLog->ReportDropped(reporter);
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastReclaim >= std::chrono::milliseconds(SHARED_LOG_RECLAIM_PERIOD_MILLIS)) {
+            m_sharedLog->ReclaimRings();
+            lastReclaim = now;
+        }
+        if (abort) {
+            break;
+        }
+        if (drained == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(SHARED_LOG_POLL_MICROS));
+        }
+    }
+}
+
+// records a producer failed to publish are reported in place of them
+void LoggerSink::KeepSharedLogDropped(int32_t pid, uint64_t dropped)
+{
+    char message[LOGGER_BUFFER_DEFAULT_LEN];
+    ::snprintf(message, sizeof(message), "%llu records of process %d dropped, too large or shared memory full",
+        static_cast<unsigned long long>(dropped), pid);
+    uint64_t timestamp = ReadSystemClockMicros();
+    LogRecord record { LoggerLevel::WARNING, __FUNCTION__, __LINE__, message, nullptr, 0, timestamp,
+        static_cast<uint64_t>(m_timezoneOffset), &GetThreadContext(), nullptr, 0 };
+    char buffer[LOGGER_BUFFER_DEFAULT_LEN];
+    std::size_t length = std::min(EncodeRecord(m_config.format, buffer, sizeof(buffer), record), sizeof(buffer));
+    AppendRecord(buffer, length, record.level, timestamp, CongestionControlPolicy::BLOCKING);
+}
+#endif
+
+/**
+ * @brief accumulate record into current index block, a new block is started
+ * once the current one covers indexInterval bytes. Must be called with m_mutex held.
+ */
+void LoggerSink::UpdateIndexBlock(LoggerLevel level, uint64_t timestamp, uint64_t bufferOffset)
+{
+    uint64_t fileOffset = m_frontendFileOffset + bufferOffset;
+    if (m_indexBlockOpen && fileOffset - m_indexBlock.offset >= m_config.indexInterval) {
+        CloseIndexBlock();
+    }
+    if (!m_indexBlockOpen) {
+        std::memset(&m_indexBlock, 0, sizeof(m_indexBlock));
+        m_indexBlock.offset = fileOffset;
+        m_indexBlock.beginTime = timestamp;
+        m_indexBlock.endTime = timestamp;
+        m_indexBlockOpen = true;
+    }
+    m_indexBlock.beginTime = std::min(m_indexBlock.beginTime, timestamp);
+    m_indexBlock.endTime = std::max(m_indexBlock.endTime, timestamp);
+    m_indexBlock.levelCounts[static_cast<uint32_t>(level)]++;
+}
+
+void LoggerSink::CloseIndexBlock()
+{
+    if (m_indexBlockOpen) {
+        m_frontendIndex.push_back(m_indexBlock);
+        m_indexBlockOpen = false;
+    }
+}
+
+/**
+ * @brief append index entries completed before last buffer switch to index file
+ */
+void LoggerSink::WriteIndexEntries(std::vector<LogIndexEntry>& entries)
+{
+    if (m_output.indexFile && !entries.empty()) {
+        m_output.indexFile->write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(LogIndexEntry));
+        m_output.indexFile->flush();
+    }
+    entries.clear();
+}
+
+/**
+ * @brief start writing a swapped out buffer at the end of log file. With io_uring the write is
+ * only submitted and the buffer is recycled when its completion is reaped, blocking write otherwise.
+ */
+void LoggerSink::SubmitWrite(LogWriteBuffer* buffer)
+{
+    buffer->written = 0;
+    buffer->done = false;
+    m_pendingWrites.push_back(buffer);
+    uint32_t owner = WRITE_UNCLAIMED;
+    if (!buffer->writeOwner.compare_exchange_strong(owner, WRITE_BY_CONSUMER, std::memory_order_acq_rel)) {
+        // taken by crash handler, which writes it by itself
+        buffer->done = true;
+        RetireWrites();
+        return;
+    }
+#ifdef MINILOGGER_HAS_IO_URING
+    if (m_ioUring && SubmitAsyncWrite(buffer)) {
+        return;
+    }
+#endif
+    WriteBufferSync(buffer);
+    RetireWrites();
+}
+
+// write the rest of buffer in consumer thread
+void LoggerSink::WriteBufferSync(LogWriteBuffer* buffer)
+{
+#ifdef MINILOGGER_HAS_IO_URING
+    while (m_output.fd >= 0 && buffer->written < buffer->TotalLength()) {
+        LogSegment segments[2];
+        buffer->PendingSegments(segments);
+        ssize_t ret = ::pwrite(m_output.fd, segments[0].data, segments[0].length, buffer->fileOffset + buffer->written);
+        if (ret < 0 && errno == EINTR) {
+            continue;
         }
-        m_notFull.wait(lk, [&]() {
-            return m_frontendBufferOffset + length < m_config.bufferSize; 
-        });
-        // write n bytes to frontendBuffer from offset
-        memcpy(m_frontendBuffer + m_frontendBufferOffset, buffer, length);
-        m_frontendBufferOffset += length;
-        m_notEmpty.notify_one();
+        if (ret <= 0) {
+            InternalErrorLog("failed to write log file, errno = %d", errno);
+            break;
+        }
+        buffer->written += static_cast<uint64_t>(ret);
     }
-    if (bufferEx != nullptr) {
-        delete[] bufferEx;
-        bufferEx = nullptr;
+#endif
+    if (m_output.file) {
+        LogSegment segments[2];
+        uint32_t segmentsNum = buffer->PendingSegments(segments);
+        for (uint32_t i = 0; i < segmentsNum; i++) {
+            m_output.file->write(segments[i].data, segments[i].length);
+        }
+        // a retired buffer must not stay in ofstream's own buffer, crash handler only rewrites buffers in flight
+        m_output.file->flush();
     }
+    buffer->written = buffer->TotalLength();
+    buffer->done = true;
+    buffer->writeOwner.store(WRITE_COMPLETED, std::memory_order_release);
 }
 
-bool LoggerImpl::Init(const LoggerConfig& conf)
+#ifdef MINILOGGER_HAS_IO_URING
+bool LoggerSink::SubmitAsyncWrite(LogWriteBuffer* buffer)
 {
-    if (m_inited) {
-        return true;
+    LogSegment segments[2];
+    uint32_t segmentsNum = buffer->PendingSegments(segments);
+    for (uint32_t i = 0; i < segmentsNum; i++) {
+        buffer->iov[i].iov_base = const_cast<char*>(segments[i].data);
+        buffer->iov[i].iov_len = segments[i].length;
     }
-    m_timezoneTimestampOffset = GetCurrentTimezoneOffset() * 60 * 60;
-    m_config = conf;
-    if (m_config.target == LoggerTarget::FILE) {
-        if (InitLoggerFileOutput() &&
-            InitLoggerBuffer() &&
-            StartConsumerThread()) {
-            m_inited = true;
-        } else {
-            m_inited = false;
+    return m_ioUring->SubmitWrite(m_output.fd, buffer->iov, segmentsNum, buffer->fileOffset + buffer->written,
+        static_cast<uint64_t>(reinterpret_cast<uintptr_t>(buffer)));
+}
+#endif
+
+/**
+ * @brief handle completed writes, wait until the oldest pending write completes if wait is true
+ */
+void LoggerSink::ReapWrites(bool wait)
+{
+#ifdef MINILOGGER_HAS_IO_URING
+    uint64_t userData = 0;
+    int32_t result = 0;
+    while (m_ioUring && !m_pendingWrites.empty()) {
+        bool waitOldest = wait && !m_pendingWrites.front()->done;
+        if (!m_ioUring->PopCompletion(waitOldest, userData, result)) {
+            if (waitOldest) {
+                // io_uring broken, finish pending writes synchronously and never submit again
+                InternalErrorLog("failed to wait io_uring completion, errno = %d", errno);
+                for (LogWriteBuffer* buffer : m_pendingWrites) {
+                    WriteBufferSync(buffer);
+                }
+                m_ioUring.reset();
+            }
+            break;
+        }
+        LogWriteBuffer* buffer = reinterpret_cast<LogWriteBuffer*>(static_cast<uintptr_t>(userData));
+        if (result > 0) {
+            buffer->written += static_cast<uint64_t>(result);
+        }
+        if (buffer->written >= buffer->TotalLength()) {
+            buffer->done = true;
+            buffer->writeOwner.store(WRITE_COMPLETED, std::memory_order_release);
+        } else if (result <= 0 || !SubmitAsyncWrite(buffer)) {
+            // failed or short write which can not be resubmitted, retry synchronously
+            WriteBufferSync(buffer);
         }
-    } else {
-        m_inited = true;
     }
-    return m_inited;
+#else
+    (void)wait;
+#endif
+    RetireWrites();
 }
 
-bool LoggerImpl::InitLoggerBuffer()
+/**
+ * @brief recycle written buffers in submission order, so index entries are appended in file order
+ */
+void LoggerSink::RetireWrites()
+{
+    while (!m_pendingWrites.empty() && m_pendingWrites.front()->done) {
+        LogWriteBuffer* buffer = m_pendingWrites.front();
+        m_pendingWrites.pop_front();
+        uint32_t owner = WRITE_COMPLETED;
+        buffer->writeOwner.compare_exchange_strong(owner, WRITE_UNCLAIMED, std::memory_order_acq_rel);
+        buffer->inFlight.store(false, std::memory_order_release);
+        buffer->chain.reset();
+        buffer->chainLength = 0;
+        WriteIndexEntries(buffer->index);
+        m_freeWriteBuffers.push_back(buffer);
+    }
+}
+
+void LoggerSink::DrainWrites()
+{
+    while (!m_pendingWrites.empty()) {
+        ReapWrites(true);
+    }
+}
+
+bool LoggerSink::InitLoggerBuffer()
 {
     if (m_config.bufferSize > LOGGER_BUFFER_SIZE_MAX / 2) {
         return false;
     }
     ResetBuffer();
+    std::size_t indexCapacity = m_config.indexInterval == 0 ? 0 : m_config.bufferSize / m_config.indexInterval + 1;
+    m_frontendIndex.reserve(indexCapacity);
     m_frontendBuffer = new (std::nothrow) char[m_config.bufferSize];
     if (m_frontendBuffer == nullptr) {
         return false;
     }
-    m_backendBuffer = new (std::nothrow) char[m_config.bufferSize];
-    if (m_backendBuffer == nullptr) {
-        delete[] m_frontendBuffer;
-        m_frontendBuffer = nullptr;
-        return false;
+    for (uint32_t i = 0; i < m_writeQueueDepth; i++) {
+        std::unique_ptr<LogWriteBuffer> buffer(new LogWriteBuffer());
+        buffer->data = new (std::nothrow) char[m_config.bufferSize];
+        if (buffer->data == nullptr) {
+            ResetBuffer();
+            return false;
+        }
+        buffer->index.reserve(indexCapacity);
+        m_freeWriteBuffers.push_back(buffer.get());
+        m_writeBuffers.push_back(std::move(buffer));
     }
     return true;
 }
 
-std::string LoggerImpl::GetCurrentLogFilePath() const
+std::string LoggerSink::GetCurrentLogFilePath() const
 {
     return m_config.logDirPath + SEPARATOR + m_config.fileName;
 }
 
+std::string LoggerSink::GetCurrentIndexFilePath() const
+{
+    return GetCurrentLogFilePath() + MINILOGGER_INDEX_FILE_EXTENSION;
+}
+
+std::string LoggerSink::GetNextLogFilePath() const
+{
+    return GetCurrentLogFilePath() + MINILOGGER_NEXT_FILE_EXTENSION;
+}
+
 /**
- * @brief generate a temp log file path to rename current log file
+ * @brief name rotated files by local rotation time, ${archiveFileName}.yyyyMMdd-HHmmss.NNN.zip where NNN
+ * distinguishes rotations in the same second, so archives sort by name in rotation order
  */
-std::string LoggerImpl::GenerateTempLogFilePath() const
+void LoggerSink::GenerateRotatedFilePaths(ArchiveTask& task) const
 {
-    // temp file suffix need to be unique to handle concurrent rename case
-    std::string timestamp = std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
-    std::string tempFileSuffix = std::string(".") + timestamp + ".tmp";
-    return m_config.logDirPath + SEPARATOR + m_config.fileName + tempFileSuffix;
+    DateTime dt = ParseDateTimeFromSeconds(
+        static_cast<uint64_t>(std::time(nullptr)), static_cast<uint64_t>(m_timezoneOffset));
+    char stamp[32] = { '\0' };
+    for (uint32_t sequence = 0; sequence < 1000; sequence++) {
+        ::snprintf(stamp, sizeof(stamp), "%04d%02d%02d-%02d%02d%02d.%03u",
+            static_cast<int>(dt.year), static_cast<int>(dt.month), static_cast<int>(dt.day),
+            static_cast<int>(dt.hours), static_cast<int>(dt.minutes), static_cast<int>(dt.seconds), sequence);
+        task.archiveFilePath = m_config.logDirPath + SEPARATOR + m_config.archiveFileName + "." + stamp +
+            MINILOGGER_ARCHIVE_FILE_EXTENSION;
+        task.tempLogFilePath = GetCurrentLogFilePath() + "." + stamp + MINILOGGER_TEMP_FILE_EXTENSION;
+        // archive of a previous rotation in this second may still be in progress
+        if (!fsutility::Exists(task.archiveFilePath) && !fsutility::Exists(task.tempLogFilePath)) {
+            break;
+        }
+    }
+    task.tempIndexFilePath = m_config.indexInterval == 0 ? "" : task.tempLogFilePath + MINILOGGER_INDEX_FILE_EXTENSION;
 }
 
 /**
- * @brief generate a archive file path for current log file
+ * @brief next hourly or daily boundary of local time after now in seconds since epoch, 0 if disabled
  */
-std::string LoggerImpl::GenerateArchiveFilePath() const
+uint64_t LoggerSink::NextRotationTime(uint64_t now) const
 {
-    std::string timestamp = std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
-    std::string archiveFileName = m_config.archiveFileName + "." + timestamp + MINILOGGER_ARCHIVE_FILE_EXTENSION;
-    std::string archiveFilePath = m_config.logDirPath + SEPARATOR + archiveFileName;
-    return archiveFilePath;
+    int64_t period = 0;
+    if (m_config.rotationPeriod == LoggerRotationPeriod::HOURLY) {
+        period = 60 * 60;
+    } else if (m_config.rotationPeriod == LoggerRotationPeriod::DAILY) {
+        period = 24 * 60 * 60;
+    } else {
+        return 0;
+    }
+    int64_t localTime = static_cast<int64_t>(now) + m_timezoneOffset;
+    return static_cast<uint64_t>((localTime / period + 1) * period - m_timezoneOffset);
 }
 
-bool LoggerImpl::InitLoggerFileOutput()
+bool LoggerSink::InitLoggerFileOutput()
 {
     try {
         if (!fsutility::IsDirectory(m_config.logDirPath)) {
             return false;
         }
-        m_file.open(GetCurrentLogFilePath(), std::ios::binary | std::ios::app);
-        if (!m_file) {
+        m_fileSize = fsutility::GetFileSize(GetCurrentLogFilePath());
+        m_frontendFileOffset = m_fileSize;
+        m_nextRotationTime = NextRotationTime(static_cast<uint64_t>(std::time(nullptr)));
+        if (!OpenLogFiles(GetCurrentLogFilePath(), m_output)) {
+            CloseLogFiles(m_output);
+            return false;
+        }
+        PublishCrashFd();
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief open log file in append mode and its index file, index magic is written if index file is new
+ */
+bool LoggerSink::OpenLogFiles(const std::string& logFilePath, LogFileHandles& handles) const
+{
+    if (m_useFileDescriptor) {
+#ifdef MINILOGGER_HAS_IO_URING
+        // writes carry explicit file offsets, so log file is not opened in append mode
+        handles.fd = ::open(logFilePath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+#endif
+        if (handles.fd < 0) {
+            return false;
+        }
+    } else {
+        handles.file.reset(new std::ofstream(logFilePath, std::ios::binary | std::ios::app));
+        if (!*handles.file) {
             return false;
         }
+    }
+#ifdef MINILOGGER_HAS_CRASH_HANDLER
+    if (m_config.crashHandler) {
+        handles.crashFd = ::open(logFilePath.c_str(), O_WRONLY | O_CLOEXEC);
+    }
+#endif
+    if (m_config.indexInterval != 0) {
+        std::string indexFilePath = logFilePath + MINILOGGER_INDEX_FILE_EXTENSION;
+        bool newIndexFile = fsutility::GetFileSize(indexFilePath) == 0;
+        handles.indexFile.reset(new std::ofstream(indexFilePath, std::ios::binary | std::ios::app));
+        if (*handles.indexFile && newIndexFile) {
+            handles.indexFile->write(MINILOGGER_INDEX_FILE_MAGIC, sizeof(MINILOGGER_INDEX_FILE_MAGIC));
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief hand crash fd of current output over to crash handler, the replaced one is closed after that.
+ * Crash handler sets m_crashing before it loads crash fd, the replaced one is kept open if it's set.
+ */
+void LoggerSink::PublishCrashFd()
+{
+#ifdef MINILOGGER_HAS_CRASH_HANDLER
+    int replaced = m_crashFd.exchange(m_output.crashFd, std::memory_order_seq_cst);
+    m_output.crashFd = -1;
+    if (replaced >= 0 && !m_crashing.load(std::memory_order_seq_cst)) {
+        ::close(replaced);
+    }
+#endif
+}
+
+void LoggerSink::CloseLogFiles(LogFileHandles& handles)
+{
+#ifdef MINILOGGER_HAS_CRASH_HANDLER
+    if (handles.crashFd >= 0) {
+        ::close(handles.crashFd);
+        handles.crashFd = -1;
+    }
+#endif
+#ifdef MINILOGGER_HAS_IO_URING
+    if (handles.fd >= 0) {
+        ::close(handles.fd);
+        handles.fd = -1;
+    }
+#endif
+    if (handles.file) {
+        handles.file->flush();
+        handles.file.reset();
+    }
+    handles.indexFile.reset();
+}
+
+bool LoggerSink::StartRotationThread()
+{
+    try {
+        m_rotationThread = std::thread(&LoggerSink::RotationThread, this);
     } catch (...) {
         return false;
     }
     return true;
 }
 
-bool LoggerImpl::StartConsumerThread()
+/**
+ * @brief keep next log file prepared and compress rotated files, so that consumer thread
+ * only renames files and switches handles when rotating
+ */
+void LoggerSink::RotationThread()
+{
+    while (true) {
+        std::unique_lock<std::mutex> lk(m_rotationMutex);
+        m_rotationCond.wait(lk, [&]() {
+            return m_rotationAbort || (!m_nextOutputReady && !m_switchingOutput) || !m_archiveTasks.empty();
+        });
+        if (!m_nextOutputReady && !m_switchingOutput && !m_rotationAbort) {
+            lk.unlock();
+            LogFileHandles next;
+            PrepareNextLogFiles(next);
+            lk.lock();
+            // handles are left empty if failed, consumer thread will open log file by itself
+            std::swap(m_nextOutput, next);
+            m_nextOutputReady = true;
+            continue;
+        }
+        if (!m_archiveTasks.empty()) {
+            ArchiveTask task = m_archiveTasks.front();
+            m_archiveTasks.pop_front();
+            lk.unlock();
+            CreateArchiveFile(task);
+            continue;
+        }
+        break;
+    }
+    // next log file is never handed off
+    CloseLogFiles(m_nextOutput);
+    fsutility::RemoveFile(GetNextLogFilePath());
+    fsutility::RemoveFile(GetNextLogFilePath() + MINILOGGER_INDEX_FILE_EXTENSION);
+}
+
+void LoggerSink::PrepareNextLogFiles(LogFileHandles& handles)
+{
+    std::string nextLogFilePath = GetNextLogFilePath();
+    // may be left by last run
+    fsutility::RemoveFile(nextLogFilePath);
+    fsutility::RemoveFile(nextLogFilePath + MINILOGGER_INDEX_FILE_EXTENSION);
+    if (!OpenLogFiles(nextLogFilePath, handles)) {
+        InternalErrorLog("failed to prepare next log file %s", nextLogFilePath.c_str());
+        CloseLogFiles(handles);
+        return;
+    }
+    fsutility::PreallocateFile(nextLogFilePath, std::min<uint64_t>(m_config.fileSizeMax, LOG_FILE_PREALLOCATE_SIZE_MAX));
+}
+
+bool LoggerSink::StartConsumerThread()
 {
     try {
-        m_consumerThread = std::thread(&LoggerImpl::ConsumerThread, this);
+        m_consumerThread = std::thread(&LoggerSink::ConsumerThread, this);
     } catch (...) {
         return false;
     }
     return true;
 }
 
-void LoggerImpl::ConsumerThread()
+void LoggerSink::ConsumerThread()
 {
+#ifdef MINILOGGER_HAS_CRASH_HANDLER
+    if (m_config.crashHandler) {
+        SetupCrashSignalStack();
+    }
+#endif
+    auto lastCalibrateTime = std::chrono::steady_clock::now();
+    const auto calibratePeriod = std::chrono::microseconds(TICK_CLOCK_CALIBRATE_PERIOD_MICROS);
     while (true) {
+        if (m_tickClock != nullptr && std::chrono::steady_clock::now() - lastCalibrateTime >= calibratePeriod) {
+            m_tickClock->Calibrate();
+            lastCalibrateTime = std::chrono::steady_clock::now();
+        }
+        // a written buffer is required to swap with frontend
+        ReapWrites(m_freeWriteBuffers.empty());
+        LogWriteBuffer* buffer = nullptr;
+        bool rotate = false;
         {
             std::unique_lock<std::mutex> lk(m_mutex);
-            m_notEmpty.wait(lk, [&]() { return m_abort || m_frontendBufferOffset != 0; });
-            if (m_frontendBufferOffset == 0) {
+            if (FrontendEmpty() && !m_abort && !m_pendingWrites.empty()) {
+                // nothing to swap, finish writes in flight while idle
+                lk.unlock();
+                DrainWrites();
+                continue;
+            }
+            // wake up periodically to keep tick clock calibrated and to rotate on time
+            auto deadline = std::chrono::steady_clock::time_point::max();
+            if (m_tickClock != nullptr) {
+                deadline = lastCalibrateTime + calibratePeriod;
+            }
+            if (m_nextRotationTime != 0) {
+                uint64_t now = static_cast<uint64_t>(std::time(nullptr));
+                auto untilRotation = std::chrono::seconds(m_nextRotationTime > now ? m_nextRotationTime - now : 0);
+                deadline = std::min(deadline, std::chrono::steady_clock::now() + untilRotation);
+            }
+            auto hasData = [&]() { return m_abort || !FrontendEmpty(); };
+            if (deadline == std::chrono::steady_clock::time_point::max()) {
+                m_notEmpty.wait(lk, hasData);
+            } else {
+                m_notEmpty.wait_until(lk, deadline, hasData);
+            }
+            bool rotateByTime = m_nextRotationTime != 0 &&
+                static_cast<uint64_t>(std::time(nullptr)) >= m_nextRotationTime;
+            if (FrontendEmpty() && !m_abort) {
+                if (rotateByTime) {
+                    // idle at time boundary, rotate without switching buffer
+                    std::vector<LogIndexEntry> index;
+                    CloseIndexBlock();
+                    std::swap(m_frontendIndex, index);
+                    m_frontendFileOffset = 0;
+                    m_rotating.store(true, std::memory_order_release);
+                    lk.unlock();
+                    WriteIndexEntries(index);
+                    SwitchToNewLogFile();
+                    m_rotating.store(false, std::memory_order_release);
+                }
+                continue;
+            }
+            if (FrontendEmpty()) {
                 // unblocked due to abort
                 break;
             }
+            m_swapping.store(true, std::memory_order_seq_cst);
+            if (m_crashing.load(std::memory_order_seq_cst)) {
+                // crash handler owns frontend and buffers now, stay away until Destroy()
+                m_swapping.store(false, std::memory_order_release);
+                m_notEmpty.wait(lk, [&]() { return m_abort; });
+                break;
+            }
             // switch buffer
-            std::swap(m_frontendBuffer, m_backendBuffer);
-            m_backendBufferOffset = m_frontendBufferOffset;
+            rotate = rotateByTime ||
+                m_fileSize + m_frontendBufferOffset + m_frontendChainLength >= m_config.fileSizeMax;
+            if (rotate) {
+                // index block never spans files
+                CloseIndexBlock();
+            }
+            buffer = m_freeWriteBuffers.back();
+            m_freeWriteBuffers.pop_back();
+            std::swap(m_frontendIndex, buffer->index);
+            std::swap(m_frontendBuffer, buffer->data);
+            buffer->length = m_frontendBufferOffset;
+            buffer->chain = std::move(m_frontendChain);
+            buffer->chainLength = m_frontendChainLength;
+            m_frontendChainLength = 0;
+            buffer->fileOffset = m_fileSize;
+            buffer->inFlight.store(true, std::memory_order_release);
+            m_rotating.store(rotate, std::memory_order_release);
             m_frontendBufferOffset = 0;
+            m_frontendFileOffset = rotate ? 0 : m_fileSize + buffer->TotalLength();
+            m_swapping.store(false, std::memory_order_release);
             // frontend threads can be recovered
             m_notFull.notify_all();
         }
-        // start I/O
-        m_file.write(m_backendBuffer, m_backendBufferOffset);
-        if (m_file.tellp() >= m_config.fileSizeMax) {
+        // start I/O, a blocking write retires buffer right away
+        m_fileSize += buffer->TotalLength();
+        SubmitWrite(buffer);
+        if (rotate) {
+            DrainWrites();
             SwitchToNewLogFile();
+            m_rotating.store(false, std::memory_order_release);
         }
     }
-    if (m_file) {
-        m_file.flush();
-        m_file.close();
+    DrainWrites();
+    std::vector<LogIndexEntry> index;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        CloseIndexBlock();
+        std::swap(m_frontendIndex, index);
     }
+    WriteIndexEntries(index);
+    PublishCrashFd(); // no crash fd left
+    CloseLogFiles(m_output);
 }
 
-void LoggerImpl::SwitchToNewLogFile()
+/**
+ * @brief rename current log file for compressing and hand off to the next log file prepared
+ * by rotation thread, log file is opened here only if it's not prepared
+ */
+void LoggerSink::SwitchToNewLogFile()
 {
-    if (m_file.is_open()) {
-        m_file.close();
+    m_nextRotationTime = NextRotationTime(static_cast<uint64_t>(std::time(nullptr)));
+    if (m_fileSize == 0) {
+        return;
     }
-    std::error_code ec;
+    ArchiveTask task;
+    GenerateRotatedFilePaths(task);
+    LogFileHandles next;
+    bool nextReady = false;
+    {
+        std::lock_guard<std::mutex> lk(m_rotationMutex);
+        std::swap(nextReady, m_nextOutputReady);
+        std::swap(next, m_nextOutput);
+        // rotation thread may wake up any time, it prepares the one after next at the same path only after
+        // next log file is renamed
+        m_switchingOutput = true;
+    }
+    CloseLogFiles(m_output);
     std::string currentLogFilePath = GetCurrentLogFilePath();
-    std::string tempLogFilePath = GenerateTempLogFilePath();
-    if (!fsutility::RenameFile(currentLogFilePath, tempLogFilePath)) {
+    if (!fsutility::RenameFile(currentLogFilePath, task.tempLogFilePath)) {
         InternalErrorLog("failed to rename %s to %s",
-            currentLogFilePath.c_str(), tempLogFilePath.c_str());
+            currentLogFilePath.c_str(), task.tempLogFilePath.c_str());
+        // keep writing to current log file
+        CloseLogFiles(next);
+        OpenLogFiles(currentLogFilePath, m_output);
+        PublishCrashFd();
+        ResyncFileOffsets(fsutility::GetFileSize(currentLogFilePath));
+        {
+            std::lock_guard<std::mutex> lk(m_rotationMutex);
+            m_switchingOutput = false;
+        }
+        m_rotationCond.notify_one();
         return;
     }
-    std::string archiveFilePath = GenerateArchiveFilePath();
-    InitLoggerFileOutput();
-    AsyncCreateArchiveFile(tempLogFilePath, archiveFilePath);
+    // sidecar index follows its log file
+    if (!task.tempIndexFilePath.empty() && !fsutility::RenameFile(GetCurrentIndexFilePath(), task.tempIndexFilePath)) {
+        InternalErrorLog("failed to rename index file %s", GetCurrentIndexFilePath().c_str());
+        fsutility::RemoveFile(GetCurrentIndexFilePath());
+        task.tempIndexFilePath.clear();
+    }
+    std::string nextLogFilePath = GetNextLogFilePath();
+    bool prepared = nextReady && (next.file || next.fd >= 0);
+    if (prepared && fsutility::RenameFile(nextLogFilePath, currentLogFilePath)) {
+        if (next.indexFile &&
+            !fsutility::RenameFile(nextLogFilePath + MINILOGGER_INDEX_FILE_EXTENSION, GetCurrentIndexFilePath())) {
+            InternalErrorLog("failed to rename index file %s", nextLogFilePath.c_str());
+            next.indexFile.reset();
+        }
+        std::swap(m_output, next);
+    } else {
+        CloseLogFiles(next);
+        OpenLogFiles(currentLogFilePath, m_output);
+    }
+    PublishCrashFd();
+    m_fileSize = 0;
+    {
+        std::lock_guard<std::mutex> lk(m_rotationMutex);
+        m_switchingOutput = false;
+        m_archiveTasks.push_back(task);
+    }
+    m_rotationCond.notify_one();
 }
 
-void LoggerImpl::AsyncCreateArchiveFile(const std::string& tempLogFilePath, const std::string& archiveFilePath)
+/**
+ * @brief frontend was assumed to start a new file at rotation, records taken since then are
+ * appended to current file of fileSize bytes instead. Shift their index entries accordingly.
+ */
+void LoggerSink::ResyncFileOffsets(uint64_t fileSize)
+{
+    m_fileSize = fileSize;
+    std::lock_guard<std::mutex> lk(m_mutex);
+    uint64_t delta = fileSize - m_frontendFileOffset;
+    for (LogIndexEntry& entry : m_frontendIndex) {
+        entry.offset += delta;
+    }
+    if (m_indexBlockOpen) {
+        m_indexBlock.offset += delta;
+    }
+    m_frontendFileOffset = fileSize;
+}
+
+void LoggerSink::CreateArchiveFile(const ArchiveTask& task)
 {
+    const std::string& tempLogFilePath = task.tempLogFilePath;
+    const std::string& tempIndexFilePath = task.tempIndexFilePath;
+    const std::string& archiveFilePath = task.archiveFilePath;
     ::zip_t* archive = nullptr;
     archive = ::zip_open(archiveFilePath.c_str(), ZIP_CREATE | ZIP_TRUNCATE, NULL);
     if (archive == nullptr) {
@@ -570,37 +3488,341 @@ void LoggerImpl::AsyncCreateArchiveFile(const std::string& tempLogFilePath, cons
         return;
     }
     ::zip_file_add(archive, m_config.fileName.c_str(), source, ZIP_FL_ENC_UTF_8);
+    if (!tempIndexFilePath.empty()) {
+        // store index next to the log entry, named ${fileName}.idx
+        std::string indexEntryName = m_config.fileName + MINILOGGER_INDEX_FILE_EXTENSION;
+        ::zip_source_t* indexSource = ::zip_source_file(archive, tempIndexFilePath.c_str(), 0, 0);
+        if (indexSource != nullptr &&
+            ::zip_file_add(archive, indexEntryName.c_str(), indexSource, ZIP_FL_ENC_UTF_8) < 0) {
+            ::zip_source_free(indexSource);
+        }
+    }
     ::zip_close(archive);
     if (!fsutility::RemoveFile(tempLogFilePath)) {
         InternalErrorLog("failed to remove temp file %s", tempLogFilePath.c_str());
         return;
     }
+    if (!tempIndexFilePath.empty() && !fsutility::RemoveFile(tempIndexFilePath)) {
+        InternalErrorLog("failed to remove temp file %s", tempIndexFilePath.c_str());
+    }
+}
+
+/**
+ * @brief read whole content of a file, or of the first entry with name suffix in a zip archive
+ */
+static bool ReadLogFileContent(const std::string& path, const std::string& entrySuffix, std::string& content)
+{
+    content.clear();
+    bool isArchive = path.length() >= MINILOGGER_ARCHIVE_FILE_EXTENSION.length() &&
+        path.compare(path.length() - MINILOGGER_ARCHIVE_FILE_EXTENSION.length(),
+            MINILOGGER_ARCHIVE_FILE_EXTENSION.length(), MINILOGGER_ARCHIVE_FILE_EXTENSION) == 0;
+    if (!isArchive) {
+        std::ifstream file(path + entrySuffix, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        std::ostringstream stream;
+        stream << file.rdbuf();
+        content = stream.str();
+        return true;
+    }
+    ::zip_t* archive = ::zip_open(path.c_str(), ZIP_RDONLY, nullptr);
+    if (archive == nullptr) {
+        return false;
+    }
+    bool found = false;
+    zip_int64_t entriesNum = ::zip_get_num_entries(archive, 0);
+    for (zip_int64_t i = 0; i < entriesNum && !found; i++) {
+        const char* name = ::zip_get_name(archive, i, 0);
+        std::string entryName = name == nullptr ? "" : name;
+        bool isIndexEntry = entryName.length() >= MINILOGGER_INDEX_FILE_EXTENSION.length() &&
+            entryName.compare(entryName.length() - MINILOGGER_INDEX_FILE_EXTENSION.length(),
+                MINILOGGER_INDEX_FILE_EXTENSION.length(), MINILOGGER_INDEX_FILE_EXTENSION) == 0;
+        if (isIndexEntry != !entrySuffix.empty()) {
+            continue;
+        }
+        ::zip_file_t* entry = ::zip_fopen_index(archive, i, 0);
+        if (entry == nullptr) {
+            break;
+        }
+        char buffer[LOGGER_BUFFER_DEFAULT_LEN];
+        zip_int64_t length = 0;
+        while ((length = ::zip_fread(entry, buffer, sizeof(buffer))) > 0) {
+            content.append(buffer, static_cast<std::size_t>(length));
+        }
+        ::zip_fclose(entry);
+        found = length == 0;
+    }
+    ::zip_discard(archive);
+    return found;
+}
+
+// implement log index lookup from here
+bool xuranus::minilogger::LoadLogIndex(const std::string& path, std::vector<LogIndexEntry>& entries)
+{
+    entries.clear();
+    std::string content;
+    if (!ReadLogFileContent(path, MINILOGGER_INDEX_FILE_EXTENSION, content) ||
+        content.length() < sizeof(MINILOGGER_INDEX_FILE_MAGIC) ||
+        std::memcmp(content.data(), MINILOGGER_INDEX_FILE_MAGIC, sizeof(MINILOGGER_INDEX_FILE_MAGIC)) != 0) {
+        return false;
+    }
+    std::size_t entriesNum = (content.length() - sizeof(MINILOGGER_INDEX_FILE_MAGIC)) / sizeof(LogIndexEntry);
+    entries.resize(entriesNum);
+    if (entriesNum != 0) {
+        std::memcpy(entries.data(), content.data() + sizeof(MINILOGGER_INDEX_FILE_MAGIC),
+            entriesNum * sizeof(LogIndexEntry));
+    }
+    return true;
+}
+
+bool xuranus::minilogger::LookupLogRange(
+    const std::vector<LogIndexEntry>& entries,
+    uint64_t beginTime,
+    uint64_t endTime,
+    uint64_t& beginOffset,
+    uint64_t& endOffset)
+{
+    // records of concurrent threads are not strictly ordered, so take every block overlapping the range
+    std::size_t first = entries.size();
+    std::size_t last = entries.size();
+    for (std::size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].endTime < beginTime || entries[i].beginTime > endTime) {
+            continue;
+        }
+        if (first == entries.size()) {
+            first = i;
+        }
+        last = i;
+    }
+    if (first == entries.size()) {
+        return false;
+    }
+    beginOffset = entries[first].offset;
+    endOffset = last + 1 < entries.size() ? entries[last + 1].offset : std::numeric_limits<uint64_t>::max();
+    return true;
+}
+
+bool xuranus::minilogger::ReadLogRange(
+    const std::string& path,
+    uint64_t beginTime,
+    uint64_t endTime,
+    std::string& content)
+{
+    content.clear();
+    std::vector<LogIndexEntry> entries;
+    uint64_t beginOffset = 0;
+    uint64_t endOffset = 0;
+    if (!LoadLogIndex(path, entries)) {
+        return false;
+    }
+    if (!LookupLogRange(entries, beginTime, endTime, beginOffset, endOffset)) {
+        return true;
+    }
+    bool isArchive = path.length() >= MINILOGGER_ARCHIVE_FILE_EXTENSION.length() &&
+        path.compare(path.length() - MINILOGGER_ARCHIVE_FILE_EXTENSION.length(),
+            MINILOGGER_ARCHIVE_FILE_EXTENSION.length(), MINILOGGER_ARCHIVE_FILE_EXTENSION) == 0;
+    if (isArchive) {
+        // compressed entry can not be seeked, decompress it and cut the range
+        std::string whole;
+        if (!ReadLogFileContent(path, "", whole)) {
+            return false;
+        }
+        if (beginOffset < whole.length()) {
+            content = whole.substr(beginOffset, endOffset - beginOffset);
+        }
+        return true;
+    }
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    uint64_t fileSize = fsutility::GetFileSize(path);
+    endOffset = std::min(endOffset, fileSize);
+    if (beginOffset >= endOffset) {
+        return true;
+    }
+    content.resize(static_cast<std::size_t>(endOffset - beginOffset));
+    file.seekg(static_cast<std::streamoff>(beginOffset));
+    file.read(&content[0], static_cast<std::streamsize>(content.size()));
+    content.resize(static_cast<std::size_t>(file.gcount()));
+    return true;
 }
 
 // implement LoggerGuard from here
+static uint64_t ReadSteadyClockNanos()
+{
+    namespace chrono = std::chrono;
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// bucket i holds [2^i, 2^(i+1)) ns, the last one holds everything beyond
+static uint32_t ScopeProfileBucket(uint64_t nanos)
+{
+    uint32_t bucket = 0;
+#if defined(__GNUC__) || defined(__clang__)
+    bucket = nanos == 0 ? 0 : static_cast<uint32_t>(63 - __builtin_clzll(nanos));
+#else
+    while (nanos >>= 1) {
+        bucket++;
+    }
+#endif
+    return std::min(bucket, LOGGER_PROFILE_BUCKET_NUM - 1);
+}
+
+static void AtomicFetchMax(std::atomic<uint64_t>& target, uint64_t value)
+{
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+static void RecordScopeProfile(LoggerScopeProfile& profile, const char* function, uint32_t line, uint64_t nanos)
+{
+    if (!profile.registered.load(std::memory_order_acquire) && !profile.registered.exchange(true)) {
+        profile.function = function;
+        profile.line = line;
+        LoggerScopeProfile* head = g_scopeProfiles.load(std::memory_order_relaxed);
+        do {
+            profile.next = head;
+        } while (!g_scopeProfiles.compare_exchange_weak(head, &profile,
+            std::memory_order_release, std::memory_order_relaxed));
+    }
+    profile.sumNanos.fetch_add(nanos, std::memory_order_relaxed);
+    AtomicFetchMax(profile.minNanosInverted, ~nanos);
+    AtomicFetchMax(profile.maxNanos, nanos);
+    profile.buckets[ScopeProfileBucket(nanos)].fetch_add(1, std::memory_order_relaxed);
+}
+
 LoggerGuard::LoggerGuard(LoggerLevel level, const char* function, uint32_t line)
- : m_level(level), m_function(function), m_line(line)
+ : m_level(level), m_function(function), m_line(line),
+    m_mode(static_cast<LoggerGuardMode>(g_guardMode.load(std::memory_order_relaxed)))
+{
+    if (m_mode == LoggerGuardMode::TRACE) {
+        Log(level, function, line, "Logger Guard, Enter %s", function);
+    } else {
+        m_beginNanos = ReadSteadyClockNanos();
+    }
+}
+
+LoggerGuard::LoggerGuard(LoggerScopeProfile& profile, LoggerLevel level, const char* function, uint32_t line)
+ : LoggerGuard(level, function, line)
 {
-    Log(level, function, line, "Logger Guard, Enter %s", function);
+    m_profile = &profile;
 }
 
 LoggerGuard::~LoggerGuard()
 {
-    Log(m_level, m_function, m_line, "Logger Guard, Exit %s", m_function);
+    if (m_mode == LoggerGuardMode::TRACE) {
+        Log(m_level, m_function, m_line, "Logger Guard, Exit %s", m_function);
+        return;
+    }
+    uint64_t elapsedNanos = ReadSteadyClockNanos() - m_beginNanos;
+    if (m_profile != nullptr) {
+        RecordScopeProfile(*m_profile, m_function, m_line, elapsedNanos);
+    }
+    if (m_mode == LoggerGuardMode::ELAPSED) {
+        Log(m_level, m_function, m_line, "Logger Guard, Exit %s, elapsed %.3f us",
+            m_function, static_cast<double>(elapsedNanos) / 1000.0);
+    }
+}
+
+// upper bound of the bucket where the given ratio of samples are reached
+static uint64_t ScopeProfilePercentile(const LoggerScopeStat& stat, double ratio)
+{
+    uint64_t target = static_cast<uint64_t>(static_cast<double>(stat.count) * ratio);
+    uint64_t accumulated = 0;
+    for (uint32_t i = 0; i < LOGGER_PROFILE_BUCKET_NUM; i++) {
+        accumulated += stat.buckets[i];
+        if (accumulated > target || accumulated == stat.count) {
+            return std::min(stat.maxNanos, (static_cast<uint64_t>(1) << (i + 1)) - 1);
+        }
+    }
+    return stat.maxNanos;
+}
+
+std::vector<LoggerScopeStat> xuranus::minilogger::CollectScopeProfiles()
+{
+    std::vector<LoggerScopeStat> stats;
+    for (LoggerScopeProfile* profile = g_scopeProfiles.load(std::memory_order_acquire);
+        profile != nullptr; profile = profile->next) {
+        LoggerScopeStat stat;
+        stat.function = profile->function == nullptr ? "" : profile->function;
+        stat.line = profile->line;
+        // counters are read one by one, they may be slightly inconsistent under concurrent update
+        stat.count = 0;
+        for (uint32_t i = 0; i < LOGGER_PROFILE_BUCKET_NUM; i++) {
+            stat.buckets[i] = profile->buckets[i].load(std::memory_order_relaxed);
+            stat.count += stat.buckets[i];
+        }
+        if (stat.count == 0) {
+            continue;
+        }
+        stat.sumNanos = profile->sumNanos.load(std::memory_order_relaxed);
+        stat.minNanos = ~profile->minNanosInverted.load(std::memory_order_relaxed);
+        stat.maxNanos = profile->maxNanos.load(std::memory_order_relaxed);
+        stat.p50Nanos = ScopeProfilePercentile(stat, 0.5);
+        stat.p99Nanos = ScopeProfilePercentile(stat, 0.99);
+        stats.push_back(stat);
+    }
+    std::sort(stats.begin(), stats.end(), [](const LoggerScopeStat& lhs, const LoggerScopeStat& rhs) {
+        return lhs.sumNanos > rhs.sumNanos;
+    });
+    return stats;
+}
+
+void xuranus::minilogger::DumpScopeProfiles(std::size_t topN)
+{
+    std::vector<LoggerScopeStat> stats = CollectScopeProfiles();
+    for (std::size_t i = 0; i < stats.size() && i < topN; i++) {
+        const LoggerScopeStat& stat = stats[i];
+        LogKV(LoggerLevel::INFO, MINI_LOGGER_FUNCTION, __LINE__, "scope profile",
+            "scope", stat.function, "line", stat.line, "count", stat.count,
+            "total_us", stat.sumNanos / 1000, "avg_ns", stat.sumNanos / stat.count,
+            "min_ns", stat.minNanos, "p50_ns", stat.p50Nanos, "p99_ns", stat.p99Nanos, "max_ns", stat.maxNanos);
+    }
+}
+
+// implement LoggerContextGuard from here
+LoggerContextGuard::LoggerContextGuard(const char* key, const char* value)
+{
+    if (value == nullptr) {
+        value = "";
+    }
+    m_pushed = PushThreadContext(key, value, std::strlen(value));
+}
+
+LoggerContextGuard::LoggerContextGuard(const char* key, const std::string& value)
+{
+    m_pushed = PushThreadContext(key, value.c_str(), value.length());
+}
+
+LoggerContextGuard::~LoggerContextGuard()
+{
+    if (m_pushed) {
+        PopThreadContext();
+    }
 }
 
 LoggerStream::LoggerStream(LoggerLevel level, const char* function, uint32_t line)
  : m_level(level), m_function(function), m_line(line)
 {}
 
+LoggerStream::LoggerStream(LoggerModule* module, LoggerLevel level, const char* function, uint32_t line)
+ : m_module(module), m_level(level), m_function(function), m_line(line)
+{}
+
 LoggerStream::~LoggerStream()
 {
+    if (m_module != nullptr) {
+        if (m_module->ShouldKeepLog(m_level)) {
+            m_module->KeepLog(m_level, m_function, m_line, this->str().c_str(), nullptr, 0, ReadClock());
+        }
+        return;
+    }
     // check current log level
     if (!Logger::GetInstance()->ShouldKeepLog(m_level)) {
         return;
     }
-    namespace chrono = std::chrono;
-    using clock = std::chrono::system_clock;
-    uint64_t timestamp = chrono::duration_cast<chrono::microseconds>(clock::now().time_since_epoch()).count(); 
+    uint64_t timestamp = ReadClock();
     Logger::GetInstance()->KeepLog(m_level, m_function, m_line, this->str().c_str(), timestamp);
 }
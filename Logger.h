@@ -8,6 +8,9 @@
 #include <string>
 #include <chrono>
 #include <sstream>
+#include <type_traits>
+#include <atomic>
+#include <vector>
 /*
  *
  * @brief
@@ -55,6 +58,17 @@
 #define ERRLOG(format, ...) \
     MINI_LOGGER_LOG_FUN(MINI_LOGGER_NAMESPACE::LoggerLevel::ERROR, MINI_LOGGER_FUNCTION, __LINE__, format, __VA_ARGS__)
 
+// MODULE_LOG(g_rpcLogger, LDBG, "send %d bytes", n), module is obtained by Logger::GetModule("net.rpc")
+#define MODULE_LOG(module, LOG_LEVEL, format, ...) \
+    MINI_LOGGER_LOG_FUN(module, LOG_LEVEL, MINI_LOGGER_FUNCTION, __LINE__, format, __VA_ARGS__)
+
+#define MODULE_LOG_KV(module, LOG_LEVEL, message, ...) \
+    MINI_LOGGER_NAMESPACE::LogKV(module, LOG_LEVEL, MINI_LOGGER_FUNCTION, __LINE__, message, __VA_ARGS__)
+
+// LOG_KV(LINFO, "request done", "user", id, "latency_us", t)
+#define LOG_KV(LOG_LEVEL, message, ...) \
+    MINI_LOGGER_NAMESPACE::LogKV(LOG_LEVEL, MINI_LOGGER_FUNCTION, __LINE__, message, __VA_ARGS__)
+
 #else
 
 #define DBGLOG(format, args...) \
@@ -68,19 +82,42 @@
 
 #define ERRLOG(format, args...) \
     MINI_LOGGER_LOG_FUN(MINI_LOGGER_NAMESPACE::LoggerLevel::ERROR, MINI_LOGGER_FUNCTION, __LINE__, format, ##args)
+
+// MODULE_LOG(g_rpcLogger, LDBG, "send %d bytes", n), module is obtained by Logger::GetModule("net.rpc")
+#define MODULE_LOG(module, LOG_LEVEL, format, args...) \
+    MINI_LOGGER_LOG_FUN(module, LOG_LEVEL, MINI_LOGGER_FUNCTION, __LINE__, format, ##args)
+
+#define MODULE_LOG_KV(module, LOG_LEVEL, message, args...) \
+    MINI_LOGGER_NAMESPACE::LogKV(module, LOG_LEVEL, MINI_LOGGER_FUNCTION, __LINE__, message, ##args)
+
+// LOG_KV(LINFO, "request done", "user", id, "latency_us", t)
+#define LOG_KV(LOG_LEVEL, message, args...) \
+    MINI_LOGGER_NAMESPACE::LogKV(LOG_LEVEL, MINI_LOGGER_FUNCTION, __LINE__, message, ##args)
 #endif
 
-#define DBGLOG_GUARD \
-    MINI_LOGGER_NAMESPACE::LoggerGuard mini_logger_guard(MINI_LOGGER_NAMESPACE::LoggerLevel::DEBUG, MINI_LOGGER_FUNCTION, __LINE__)
+// every guard call site owns a static latency histogram, see Logger::SetGuardMode
+#define MINI_LOGGER_GUARD(LOG_LEVEL) \
+    static MINI_LOGGER_NAMESPACE::LoggerScopeProfile mini_logger_guard_profile; \
+    MINI_LOGGER_NAMESPACE::LoggerGuard mini_logger_guard(mini_logger_guard_profile, LOG_LEVEL, MINI_LOGGER_FUNCTION, __LINE__)
 
-#define INFOLOG_GUARD \
-    MINI_LOGGER_NAMESPACE::LoggerGuard mini_logger_guard(MINI_LOGGER_NAMESPACE::LoggerLevel::INFO, MINI_LOGGER_FUNCTION, __LINE__)
+#define DBGLOG_GUARD MINI_LOGGER_GUARD(MINI_LOGGER_NAMESPACE::LoggerLevel::DEBUG)
 
-#define WARNLOG_GUARD \
-    MINI_LOGGER_NAMESPACE::LoggerGuard mini_logger_guard(MINI_LOGGER_NAMESPACE::LoggerLevel::WARNING, MINI_LOGGER_FUNCTION, __LINE__)
+#define INFOLOG_GUARD MINI_LOGGER_GUARD(MINI_LOGGER_NAMESPACE::LoggerLevel::INFO)
+
+#define WARNLOG_GUARD MINI_LOGGER_GUARD(MINI_LOGGER_NAMESPACE::LoggerLevel::WARNING)
+
+#define MINI_LOGGER_CONCAT_IMPL(a, b) a##b
+#define MINI_LOGGER_CONCAT(a, b) MINI_LOGGER_CONCAT_IMPL(a, b)
+
+// LOG_CONTEXT("request_id", id) attach request_id=id to records of current thread until end of scope
+// a thread holds at most 32 nested pairs within 1024 bytes, pairs beyond are omitted, null value is taken as ""
+#define LOG_CONTEXT(key, value) \
+    MINI_LOGGER_NAMESPACE::LoggerContextGuard MINI_LOGGER_CONCAT(mini_logger_context_, __LINE__)(key, value)
 
 #ifdef ENABLE_STREAM_LOGGER
 #define MINI_LOG(LOG_LEVEL) MINI_LOGGER_NAMESPACE::LoggerStream(LOG_LEVEL, MINI_LOGGER_FUNCTION, __LINE__)
+#define MINI_MODULE_LOG(module, LOG_LEVEL) \
+    MINI_LOGGER_NAMESPACE::LoggerStream(module, LOG_LEVEL, MINI_LOGGER_FUNCTION, __LINE__)
 #define LOGENDL std::endl
 
 #define LDBG    MINI_LOGGER_NAMESPACE::LoggerLevel::DEBUG
@@ -98,6 +135,14 @@ const uint64_t LOGGER_FUNCTION_BUFFER_MAX_LEN = 1024;
 const std::size_t ONE_MB = 1024 * 1024;
 const std::size_t LOGGER_BUFFER_SIZE_MAX = 2 * 32 * ONE_MB;
 const std::size_t LOGGER_BUFFER_SIZE_DEFAULT = 16 * ONE_MB;
+const std::size_t LOGGER_INDEX_INTERVAL_DEFAULT = 64 * 1024;
+const uint32_t LOGGER_WRITE_QUEUE_DEPTH_DEFAULT = 4;
+const uint32_t LOGGER_LEVEL_NUM = 5;
+const uint32_t LOGGER_PROFILE_BUCKET_NUM = 40;
+const std::size_t LOGGER_SHM_RING_SIZE_DEFAULT = ONE_MB;
+const uint32_t LOGGER_SHM_RING_NUM_DEFAULT = 64;
+// raw bytes of thread local key kept in text and JSON output alike, longer key is cut on a UTF-8 character boundary
+const std::size_t LOGGER_THREAD_LOCAL_KEY_MAX_LEN = 256;
 
 enum class MINILOGGER_API LoggerLevel {
     DEBUG       = 0,
@@ -109,7 +154,8 @@ enum class MINILOGGER_API LoggerLevel {
 
 enum class MINILOGGER_API LoggerTarget {
     STDOUT      = 1,
-    FILE        = 2
+    FILE        = 2,
+    SHARED_MEMORY = 3   ///> publish into shared memory segment shmName, drained by the FILE sink of a writer process
 };
 
 enum class MINILOGGER_API CongestionControlPolicy {
@@ -117,6 +163,74 @@ enum class MINILOGGER_API CongestionControlPolicy {
     DROPPING    = 2
 };
 
+enum class MINILOGGER_API ClockSource {
+    SYSTEM      = 1,    ///> read std::chrono::system_clock for every log
+    TSC         = 2     ///> read rdtsc (steady_clock without invariant TSC), calibrated against wall clock
+};
+
+enum class MINILOGGER_API LoggerFormat {
+    TEXT        = 1,    ///> [datetime][level][message][function:line][threadID][threadLocalKey]
+    JSON        = 2     ///> one JSON object per line (JSON Lines)
+};
+
+enum class MINILOGGER_API LoggerRotationPeriod {
+    NONE        = 1,    ///> rotate by fileSizeMax only
+    HOURLY      = 2,    ///> also rotate at every hour of local time
+    DAILY       = 3     ///> also rotate at every midnight of local time
+};
+
+enum class MINILOGGER_API LoggerIOBackend {
+    BLOCKING    = 1,    ///> consumer thread writes one buffer at a time
+    IO_URING    = 2     ///> Linux io_uring with multiple buffers in flight, fallback to BLOCKING if not supported
+};
+
+enum class MINILOGGER_API LoggerGuardMode {
+    TRACE       = 1,    ///> log "Enter" and "Exit" records
+    ELAPSED     = 2,    ///> log one record with elapsed time on exit and feed histogram
+    PROFILE     = 3     ///> log nothing, only feed histogram of the call site regardless of log level
+};
+
+enum class MINILOGGER_API LoggerFieldType {
+    INT         = 1,
+    UINT        = 2,
+    DOUBLE      = 3,
+    BOOL        = 4,
+    STRING      = 5,
+    BYTES       = 6     ///> binary buffer rendered as hex or base64 string
+};
+
+enum class MINILOGGER_API LoggerBytesEncoding {
+    HEX         = 1,    ///> two lower case hex digits per byte
+    BASE64      = 2     ///> standard base64 with padding
+};
+
+struct LoggerStringRef {
+    const char*     data;
+    std::size_t     length;
+};
+
+struct LoggerBytesRef {
+    const void*         data;
+    std::size_t         length;
+    LoggerBytesEncoding encoding;
+};
+
+/**
+ * @brief a typed key/value field of structured log, key and string value are referenced without copy
+ */
+struct LoggerField {
+    const char*         key;
+    LoggerFieldType     type;
+    union {
+        int64_t         intValue;
+        uint64_t        uintValue;
+        double          doubleValue;
+        bool            boolValue;
+        LoggerStringRef stringValue;
+        LoggerBytesRef  bytesValue;
+    };
+};
+
 struct LoggerConfig {
     LoggerTarget    target { LoggerTarget::STDOUT };           ///> output to file or stdout
     std::string     logDirPath;                                ///> directory path to generate log file
@@ -124,7 +238,122 @@ struct LoggerConfig {
     std::size_t     fileSizeMax;                               ///> log file archive threashold in bytes
     std::string     archiveFileName;                           ///> archive file name, no extension required
     uint64_t        archiveFilesNumMax;                        ///> max num of archive file to keep
+    LoggerRotationPeriod rotationPeriod { LoggerRotationPeriod::NONE }; ///> time based rotation besides fileSizeMax
     std::size_t     bufferSize { LOGGER_BUFFER_SIZE_DEFAULT }; ///> logger takes 2 * bufferSize bytes for buffering
+    ClockSource     clockSource { ClockSource::SYSTEM };       ///> timestamp source, TSC only take effect for file target
+    LoggerFormat    format { LoggerFormat::TEXT };             ///> output encoder, text line or JSON Lines
+    std::size_t     indexInterval { LOGGER_INDEX_INTERVAL_DEFAULT }; ///> bytes per sidecar index entry, 0 to disable
+    LoggerIOBackend ioBackend { LoggerIOBackend::BLOCKING };   ///> how consumer thread writes buffers to log file
+    uint32_t        writeQueueDepth { LOGGER_WRITE_QUEUE_DEPTH_DEFAULT }; ///> max buffers in flight for IO_URING, each takes bufferSize bytes
+    std::string     shmName;                                   ///> POSIX shm segment, FILE target drains records published by other processes into it
+    std::size_t     shmRingSize { LOGGER_SHM_RING_SIZE_DEFAULT }; ///> bytes of ring of each producer process, used by whoever creates the segment
+    uint32_t        shmRingNum { LOGGER_SHM_RING_NUM_DEFAULT }; ///> max producer processes attached at a time, used by whoever creates the segment
+    bool            crashHandler { false };                    ///> on fatal signals write pending records and stack trace to log file, POSIX only. Init fails beyond 16 such sinks, each shard counts
+    uint32_t        shardNum { 1 };                            ///> split FILE target into ${fileName}.N, each shard has its own consumer thread, rotation and archives
+};
+
+/**
+ * @brief entry of the sidecar index ${fileName}.idx written next to log file and stored in archive,
+ * each entry covers about LoggerConfig::indexInterval bytes of log. Index file starts with a 8 bytes magic
+ * followed by entries in host byte order.
+ */
+struct LogIndexEntry {
+    uint64_t        offset;                         ///> byte offset of the first record of block in log file
+    uint64_t        beginTime;                      ///> min timestamp of records in block, microseconds since epoch
+    uint64_t        endTime;                        ///> max timestamp of records in block, microseconds since epoch
+    uint32_t        levelCounts[LOGGER_LEVEL_NUM];  ///> number of records of each level in block
+    uint32_t        reserved;
+};
+
+/**
+ * @brief load sidecar index of a log file or a archive file
+ */
+MINILOGGER_API bool LoadLogIndex(const std::string& path, std::vector<LogIndexEntry>& entries);
+
+/**
+ * @brief find byte range [beginOffset, endOffset) of log file covering records in [beginTime, endTime],
+ * endOffset is UINT64_MAX if the range reaches end of file. return false if no record is in range
+ */
+MINILOGGER_API bool LookupLogRange(
+    const std::vector<LogIndexEntry>& entries,
+    uint64_t beginTime,
+    uint64_t endTime,
+    uint64_t& beginOffset,
+    uint64_t& endOffset);
+
+/**
+ * @brief latency histogram of a *LOG_GUARD call site, bucket i counts scopes taking [2^i, 2^(i+1)) ns.
+ * It must have static storage duration so that it's zero initialized without a constructor,
+ * and is registered into a global lock-free list by the first guard exiting the scope.
+ */
+struct MINILOGGER_API LoggerScopeProfile {
+    std::atomic<uint64_t>   sumNanos;
+    std::atomic<uint64_t>   minNanosInverted;   ///> ~min, so that zero initial value stands for max
+    std::atomic<uint64_t>   maxNanos;
+    std::atomic<uint64_t>   buckets[LOGGER_PROFILE_BUCKET_NUM];
+    std::atomic<bool>       registered;
+    const char*             function;
+    uint32_t                line;
+    LoggerScopeProfile*     next;
+};
+
+/**
+ * @brief snapshot of a LoggerScopeProfile, percentiles are upper bounds of histogram buckets
+ */
+struct MINILOGGER_API LoggerScopeStat {
+    std::string     function;
+    uint32_t        line;
+    uint64_t        count;
+    uint64_t        sumNanos;
+    uint64_t        minNanos;
+    uint64_t        maxNanos;
+    uint64_t        p50Nanos;
+    uint64_t        p99Nanos;
+    uint64_t        buckets[LOGGER_PROFILE_BUCKET_NUM];
+};
+
+/**
+ * @brief snapshot all guard call sites executed so far, sorted by total elapsed time descending
+ */
+MINILOGGER_API std::vector<LoggerScopeStat> CollectScopeProfiles();
+
+/**
+ * @brief log summary of the topN hottest guard call sites as structured INFO records
+ */
+MINILOGGER_API void DumpScopeProfiles(std::size_t topN);
+
+/**
+ * @brief read the part of a log file or a archive file covering records in [beginTime, endTime]
+ */
+MINILOGGER_API bool ReadLogRange(const std::string& path, uint64_t beginTime, uint64_t endTime, std::string& content);
+
+/**
+ * @brief read a raw timestamp from the clock source selected by LoggerConfig::clockSource,
+ * it's converted to wall-clock microseconds by the logger when the record is kept.
+ * The raw value is tagged with its clock source, so it's converted correctly even if source is switched meanwhile
+ */
+MINILOGGER_API uint64_t ReadClock();
+
+/**
+ * @brief named logger handle of a module such as "net.rpc", obtained once by Logger::GetModule().
+ * Level and sink are inherited from the nearest configured ancestor ("net.rpc" -> "net" -> root logger),
+ * the handle is valid until process exit and resolves its level with a single atomic load.
+ */
+class MINILOGGER_API LoggerModule {
+public:
+    bool ShouldKeepLog(LoggerLevel level) const
+    {
+        return m_level.load(std::memory_order_relaxed) <= static_cast<int>(level);
+    }
+
+    virtual const std::string& Name() const = 0;
+    // timestamp is the raw value returned by ReadClock()
+    virtual void KeepLog(LoggerLevel level, const char* function, uint32_t line, const char* message,
+        const LoggerField* fields, std::size_t fieldsNum, uint64_t timestamp) = 0;
+    virtual ~LoggerModule();
+
+protected:
+    std::atomic<int>    m_level { static_cast<int>(LoggerLevel::DEBUG) };
 };
 
 class MINILOGGER_API Logger {
@@ -135,12 +364,27 @@ public:
     // change configutation that can be modified at runtime
     virtual void SetCongestionControlPolicy(CongestionControlPolicy policy) = 0;
     virtual void SetLogLevel(LoggerLevel level) = 0;
+    // key longer than LOGGER_THREAD_LOCAL_KEY_MAX_LEN is truncated
     virtual void SetThreadLocalKey(const std::string& key) = 0;
+    // select what *LOG_GUARD does, TRACE by default
+    virtual void SetGuardMode(LoggerGuardMode mode) = 0;
     // must be invoked before application exit
     virtual void Destroy() = 0;
 
+    // timestamp is the raw value returned by ReadClock()
     virtual void KeepLog(LoggerLevel level, const char* function, uint32_t line, const char* message, uint64_t timestamp) = 0;
+    virtual void KeepLog(LoggerLevel level, const char* function, uint32_t line, const char* message,
+        const LoggerField* fields, std::size_t fieldsNum, uint64_t timestamp) = 0;
     virtual bool ShouldKeepLog(LoggerLevel level) const = 0;
+
+    // get or create a named module logger, "a.b" is a child of "a"
+    virtual LoggerModule* GetModule(const std::string& name) = 0;
+    // override level of a module at runtime, descendants without explicit level follow it
+    virtual void SetModuleLogLevel(const std::string& name, LoggerLevel level) = 0;
+    // remove explicit level of a module, inherit level from its ancestor again
+    virtual void ResetModuleLogLevel(const std::string& name) = 0;
+    // route a module and its descendants to a dedicated sink with separate buffers and output
+    virtual bool InitModuleSink(const std::string& name, const LoggerConfig& conf) = 0;
     virtual ~Logger();
 };
 
@@ -154,16 +398,37 @@ constexpr const char* GetFunctionName(const char* function)
 }
 
 /**
- * @brief record enter/leave a function
+ * @brief record enter/leave a function, or time it according to Logger::SetGuardMode
  */
 class MINILOGGER_API LoggerGuard {
 public:
     LoggerGuard(LoggerLevel level, const char* function, uint32_t line);
+    LoggerGuard(LoggerScopeProfile& profile, LoggerLevel level, const char* function, uint32_t line);
     ~LoggerGuard();
+    LoggerGuard(const LoggerGuard&) = delete;
+    LoggerGuard& operator = (const LoggerGuard&) = delete;
 private:
-    LoggerLevel     m_level;
-    const char*     m_function;
-    uint32_t        m_line;
+    LoggerLevel         m_level;
+    const char*         m_function;
+    uint32_t            m_line;
+    LoggerScopeProfile* m_profile { nullptr };
+    LoggerGuardMode     m_mode;
+    uint64_t            m_beginNanos { 0 };
+};
+
+/**
+ * @brief push a key/value pair into context of current thread until the guard is destructed,
+ * the context is attached to every record of the thread after thread local key
+ */
+class MINILOGGER_API LoggerContextGuard {
+public:
+    LoggerContextGuard(const char* key, const char* value);
+    LoggerContextGuard(const char* key, const std::string& value);
+    ~LoggerContextGuard();
+    LoggerContextGuard(const LoggerContextGuard&) = delete;
+    LoggerContextGuard& operator = (const LoggerContextGuard&) = delete;
+private:
+    bool            m_pushed;
 };
 
 /**
@@ -172,13 +437,44 @@ private:
 class MINILOGGER_API LoggerStream : public std::ostringstream {
 public:
     LoggerStream(LoggerLevel level, const char* function, uint32_t line);
+    LoggerStream(LoggerModule* module, LoggerLevel level, const char* function, uint32_t line);
     ~LoggerStream();
 public:
+    LoggerModule*   m_module { nullptr };
     LoggerLevel     m_level;
     const char*     m_function;
     uint32_t        m_line;
 };
 
+// format message into buffer, messages longer than buffer are formatted again into longMessage as a whole
+template<class... Args>
+const char* FormatLogMessage(
+    char            (&messageBuffer)[LOGGER_MESSAGE_BUFFER_MAX_LEN],
+    std::string&    longMessage,
+    const char*     format,
+    Args...         args)
+{
+    if (sizeof...(args) == 0) { // empty args optimization
+        std::strncpy(messageBuffer, format, sizeof(messageBuffer) - 1);
+        return messageBuffer;
+    }
+    int length = ::snprintf(messageBuffer, LOGGER_MESSAGE_BUFFER_MAX_LEN, format, args...);
+    if (length < 0) {
+        // TODO
+        std::fill(messageBuffer, messageBuffer + LOGGER_MESSAGE_BUFFER_MAX_LEN, 0);
+        std::strncpy(messageBuffer, "...", sizeof(messageBuffer) - 1);
+        return messageBuffer;
+    }
+    if (static_cast<uint64_t>(length) < LOGGER_MESSAGE_BUFFER_MAX_LEN) {
+        return messageBuffer;
+    }
+    // the first call measured the whole length
+    longMessage.resize(static_cast<std::size_t>(length) + 1);
+    ::snprintf(&longMessage[0], longMessage.size(), format, args...);
+    longMessage.resize(static_cast<std::size_t>(length));
+    return longMessage.c_str();
+}
+
 // format
 template<class... Args>
 void Log(
@@ -192,21 +488,184 @@ void Log(
     if (!Logger::GetInstance()->ShouldKeepLog(level)) {
         return;
     }
-    namespace chrono = std::chrono;
-    using clock = std::chrono::system_clock;
-    uint64_t timestamp = chrono::duration_cast<chrono::microseconds>(clock::now().time_since_epoch()).count(); 
+    uint64_t timestamp = ReadClock();
+    if (sizeof...(args) == 0) {
+        // literal message is kept as it is, neither copied nor truncated
+        Logger::GetInstance()->KeepLog(level, function, line, format, timestamp);
+        return;
+    }
     char messageBuffer[LOGGER_MESSAGE_BUFFER_MAX_LEN] = { '\0' };
-    if (sizeof...(args) == 0) { // empty args optimization
-        std::strncpy(messageBuffer, format, sizeof(messageBuffer) - 1);
-        Logger::GetInstance()->KeepLog(level, function, line, messageBuffer, timestamp);
+    std::string longMessage;
+    const char* message = FormatLogMessage(messageBuffer, longMessage, format, args...);
+    Logger::GetInstance()->KeepLog(level, function, line, message, timestamp);
+}
+
+// format to module logger
+template<class... Args>
+void Log(
+    LoggerModule*   module,
+    LoggerLevel     level,
+    const char*     function,
+    uint32_t        line,
+    const char*     format,
+    Args...         args)
+{
+    // check current log level of module
+    if (!module->ShouldKeepLog(level)) {
         return;
     }
-    if (::snprintf(messageBuffer, LOGGER_MESSAGE_BUFFER_MAX_LEN, format, args...) < 0) {
-        // TODO
-        std::fill(messageBuffer, messageBuffer + LOGGER_MESSAGE_BUFFER_MAX_LEN, 0);
-        std::strncpy(messageBuffer, "...", sizeof(messageBuffer) - 1);
+    uint64_t timestamp = ReadClock();
+    if (sizeof...(args) == 0) {
+        // literal message is kept as it is, neither copied nor truncated
+        module->KeepLog(level, function, line, format, nullptr, 0, timestamp);
+        return;
+    }
+    char messageBuffer[LOGGER_MESSAGE_BUFFER_MAX_LEN] = { '\0' };
+    std::string longMessage;
+    const char* message = FormatLogMessage(messageBuffer, longMessage, format, args...);
+    module->KeepLog(level, function, line, message, nullptr, 0, timestamp);
+}
+
+// structured log fields
+inline LoggerField MakeLoggerField(const char* key, bool value)
+{
+    LoggerField field;
+    field.key = key;
+    field.type = LoggerFieldType::BOOL;
+    field.boolValue = value;
+    return field;
+}
+
+template<class T>
+typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, LoggerField>::type
+MakeLoggerField(const char* key, T value)
+{
+    LoggerField field;
+    field.key = key;
+    field.type = LoggerFieldType::INT;
+    field.intValue = static_cast<int64_t>(value);
+    return field;
+}
+
+template<class T>
+typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value, LoggerField>::type
+MakeLoggerField(const char* key, T value)
+{
+    LoggerField field;
+    field.key = key;
+    field.type = LoggerFieldType::UINT;
+    field.uintValue = static_cast<uint64_t>(value);
+    return field;
+}
+
+template<class T>
+typename std::enable_if<std::is_floating_point<T>::value, LoggerField>::type
+MakeLoggerField(const char* key, T value)
+{
+    LoggerField field;
+    field.key = key;
+    field.type = LoggerFieldType::DOUBLE;
+    field.doubleValue = static_cast<double>(value);
+    return field;
+}
+
+inline LoggerField MakeLoggerField(const char* key, const char* value)
+{
+    LoggerField field;
+    field.key = key;
+    field.type = LoggerFieldType::STRING;
+    field.stringValue.data = value == nullptr ? "" : value;
+    field.stringValue.length = value == nullptr ? 0 : std::strlen(value);
+    return field;
+}
+
+inline LoggerField MakeLoggerField(const char* key, const std::string& value)
+{
+    LoggerField field;
+    field.key = key;
+    field.type = LoggerFieldType::STRING;
+    field.stringValue.data = value.c_str();
+    field.stringValue.length = value.length();
+    return field;
+}
+
+// LOG_KV(LDBG, "packet received", "payload", LoggerHex(buffer, length)), buffer is referenced without copy
+inline LoggerBytesRef LoggerHex(const void* data, std::size_t length)
+{
+    LoggerBytesRef bytes;
+    bytes.data = data;
+    bytes.length = data == nullptr ? 0 : length;
+    bytes.encoding = LoggerBytesEncoding::HEX;
+    return bytes;
+}
+
+inline LoggerBytesRef LoggerBase64(const void* data, std::size_t length)
+{
+    LoggerBytesRef bytes;
+    bytes.data = data;
+    bytes.length = data == nullptr ? 0 : length;
+    bytes.encoding = LoggerBytesEncoding::BASE64;
+    return bytes;
+}
+
+inline LoggerField MakeLoggerField(const char* key, const LoggerBytesRef& value)
+{
+    LoggerField field;
+    field.key = key;
+    field.type = LoggerFieldType::BYTES;
+    field.bytesValue = value;
+    return field;
+}
+
+inline void FillLoggerFields(LoggerField*)
+{}
+
+template<class V, class... Rest>
+void FillLoggerFields(LoggerField* fields, const char* key, const V& value, const Rest&... rest)
+{
+    *fields = MakeLoggerField(key, value);
+    FillLoggerFields(fields + 1, rest...);
+}
+
+// structured log, args are key/value pairs
+template<class... Args>
+void LogKV(
+    LoggerLevel     level,
+    const char*     function,
+    uint32_t        line,
+    const char*     message,
+    const Args&...  args)
+{
+    static_assert(sizeof...(args) % 2 == 0, "LOG_KV requires key/value pairs");
+    // check current log level
+    if (!Logger::GetInstance()->ShouldKeepLog(level)) {
+        return;
+    }
+    uint64_t timestamp = ReadClock();
+    LoggerField fields[sizeof...(args) / 2 + 1];
+    FillLoggerFields(fields, args...);
+    Logger::GetInstance()->KeepLog(level, function, line, message, fields, sizeof...(args) / 2, timestamp);
+}
+
+// structured log to module logger, args are key/value pairs
+template<class... Args>
+void LogKV(
+    LoggerModule*   module,
+    LoggerLevel     level,
+    const char*     function,
+    uint32_t        line,
+    const char*     message,
+    const Args&...  args)
+{
+    static_assert(sizeof...(args) % 2 == 0, "MODULE_LOG_KV requires key/value pairs");
+    // check current log level of module
+    if (!module->ShouldKeepLog(level)) {
+        return;
     }
-    Logger::GetInstance()->KeepLog(level, function, line, messageBuffer, timestamp);
+    uint64_t timestamp = ReadClock();
+    LoggerField fields[sizeof...(args) / 2 + 1];
+    FillLoggerFields(fields, args...);
+    module->KeepLog(level, function, line, message, fields, sizeof...(args) / 2, timestamp);
 }
 
 }
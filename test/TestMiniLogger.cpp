@@ -12,12 +12,27 @@
 #include <vector>
 #include <string>
 #include <thread>
+#include <limits>
+#include <algorithm>
+#include <fstream>
+#include <chrono>
+#include <ctime>
+#include <cmath>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
 
 #ifdef _WIN32
 #include <direct.h>
+#include <io.h>
 #define GetCurrentDir _getcwd
 #else
 #include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
 #define GetCurrentDir getcwd
 #endif
 
@@ -25,6 +40,115 @@
 
 namespace {
     const std::string LOGGER_FILE_NAME = "demo.log";
+
+    // sorted names of files in dirPath starting with prefix
+    std::vector<std::string> ListLogFiles(const std::string& dirPath, const std::string& prefix)
+    {
+        std::vector<std::string> names;
+#ifdef _WIN32
+        struct _finddata_t entry;
+        intptr_t handle = ::_findfirst((dirPath + "\\" + prefix + "*").c_str(), &entry);
+        if (handle != -1) {
+            do {
+                names.push_back(entry.name);
+            } while (::_findnext(handle, &entry) == 0);
+            ::_findclose(handle);
+        }
+#else
+        DIR* dir = ::opendir(dirPath.c_str());
+        if (dir != nullptr) {
+            for (struct dirent* entry = ::readdir(dir); entry != nullptr; entry = ::readdir(dir)) {
+                std::string name = entry->d_name;
+                if (name.compare(0, prefix.length(), prefix) == 0) {
+                    names.push_back(name);
+                }
+            }
+            ::closedir(dir);
+        }
+#endif
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    // remove outputs of previous run whose names start with prefix, such as "shard.log" for "shard.log.0.idx"
+    void RemoveLogFiles(const std::string& dirPath, const std::string& prefix)
+    {
+        for (const std::string& name : ListLogFiles(dirPath, prefix)) {
+            std::remove((dirPath + "/" + name).c_str());
+        }
+    }
+
+    // lines containing marker, wait for consumer thread until expectedNum of them are written or 5s elapsed
+    std::vector<std::string> WaitLogLines(const std::string& path, const std::string& marker, std::size_t expectedNum)
+    {
+        std::vector<std::string> lines;
+        for (int retry = 0; retry < 50; retry++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            std::ifstream file(path);
+            std::string line;
+            lines.clear();
+            while (std::getline(file, line)) {
+                if (line.find(marker) != std::string::npos) {
+                    lines.push_back(line);
+                }
+            }
+            if (lines.size() >= expectedNum) {
+                break;
+            }
+        }
+        return lines;
+    }
+
+    // wall-clock seconds and microseconds of a "[2023-06-23 10:00:00.123456]..." text line in local time
+    bool ParseLineTime(const std::string& line, std::time_t& seconds, int& micros)
+    {
+        std::tm tm {};
+        if (std::sscanf(line.c_str(), "[%d-%d-%d %d:%d:%d.%d]", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+            &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &micros) != 7) {
+            return false;
+        }
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        tm.tm_isdst = -1;
+        seconds = std::mktime(&tm);
+        return true;
+    }
+
+    // split a flat JSON object line into keys and raw value texts in order, nested objects are kept raw
+    bool ParseJsonObject(const std::string& line, std::vector<std::pair<std::string, std::string>>& members)
+    {
+        std::size_t i = 0;
+        auto skipString = [&]() {
+            for (i++; i < line.length() && line[i] != '"'; i++) {
+                i += line[i] == '\\' ? 1 : 0;
+            }
+            return i++ < line.length();
+        };
+        if (line.empty() || line[i++] != '{') {
+            return false;
+        }
+        while (i < line.length() && line[i] == '"') {
+            std::size_t keyBegin = i;
+            if (!skipString() || i >= line.length() || line[i++] != ':') {
+                return false;
+            }
+            std::string key = line.substr(keyBegin + 1, i - keyBegin - 3);
+            std::size_t valueBegin = i;
+            int depth = 0;
+            for (; i < line.length() && (depth > 0 || (line[i] != ',' && line[i] != '}')); i++) {
+                if (line[i] == '"') {
+                    skipString();
+                    i--;
+                }
+                depth += line[i] == '{' ? 1 : (line[i] == '}' ? -1 : 0);
+            }
+            members.emplace_back(key, line.substr(valueBegin, i - valueBegin));
+            if (i < line.length() && line[i] == ',') {
+                i++;
+            }
+        }
+        return i + 1 == line.length() && line[i] == '}';
+    }
 }
 
 class LoggerTest : public ::testing::Test {
@@ -47,6 +171,7 @@ protected:
         }
         
         conf.logDirPath = currentDir;
+        RemoveLogFiles(conf.logDirPath, LOGGER_FILE_NAME);
         std::cout << "using logger path: " << conf.logDirPath << ", name: " << conf.fileName << std::endl;
         Logger::GetInstance()->SetLogLevel(LoggerLevel::DEBUG);
         if (!Logger::GetInstance()->Init(conf)) {
@@ -76,6 +201,947 @@ TEST_F(LoggerTest, BasicLogger)
         << LOGENDL;
 }
 
+// run in a child process by death test, root logger of test process keeps using system clock
+static int RunTickClockLogger(const std::string& dirPath, const std::string& fileName, std::size_t recordsNum)
+{
+    using namespace xuranus::minilogger;
+    LoggerConfig conf {};
+    conf.target = LoggerTarget::FILE;
+    conf.fileSizeMax = 1024 * 1024 * 100; // 100MB
+    conf.archiveFileName = fileName;
+    conf.fileName = fileName;
+    conf.logDirPath = dirPath;
+    conf.clockSource = ClockSource::TSC;
+    Logger::GetInstance()->SetLogLevel(LoggerLevel::DEBUG);
+    if (!Logger::GetInstance()->Init(conf)) {
+        return 1;
+    }
+    uint64_t last = ReadClock();
+    if ((last >> 63) == 0) {
+        return 2; // not read from tick clock
+    }
+    for (int i = 0; i < 1000; i++) {
+        uint64_t current = ReadClock();
+        if (current < last) {
+            return 3;
+        }
+        last = current;
+    }
+    for (std::size_t i = 0; i < recordsNum; i++) {
+        INFOLOG("tick clock record %d", static_cast<int>(i));
+    }
+    Logger::GetInstance()->Destroy();
+    return 0;
+}
+
+TEST(TickClockTest, TickClock)
+{
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    const std::string fileName = "minilogger_tick_clock.log";
+    const std::size_t recordsNum = 100;
+    RemoveLogFiles(currentDir, fileName);
+    // threadsafe style re-executes the test binary, so the child initializes a fresh root logger with TSC
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    std::time_t begin = std::time(nullptr);
+    EXPECT_EXIT(std::exit(RunTickClockLogger(currentDir, fileName, recordsNum)), ::testing::ExitedWithCode(0), "");
+
+    // converted timestamps never go backwards and stay close to wall clock
+    std::vector<std::string> lines = WaitLogLines(std::string(currentDir) + "/" + fileName,
+        "tick clock record", recordsNum);
+    ASSERT_EQ(lines.size(), recordsNum);
+    std::time_t lastSeconds = 0;
+    int lastMicros = 0;
+    for (const std::string& line : lines) {
+        std::time_t seconds = 0;
+        int micros = 0;
+        ASSERT_TRUE(ParseLineTime(line, seconds, micros)) << line;
+        EXPECT_TRUE(seconds > lastSeconds || (seconds == lastSeconds && micros >= lastMicros)) << line;
+        EXPECT_LE(std::abs(std::difftime(seconds, begin)), 2.0) << line;
+        lastSeconds = seconds;
+        lastMicros = micros;
+    }
+}
+
+TEST_F(LoggerTest, StructuredLogger)
+{
+    using namespace xuranus::minilogger;
+    uint64_t latency = 1500;
+    int user = -42;
+    std::string path = "/api/\"quoted\"\n";
+    LOG_KV(LINFO, "request done", "user", user, "latency_us", latency, "path", path,
+        "ratio", 0.75, "cached", true, "region", "cn-north");
+    LOG_KV(LWARN, "no fields");
+
+    // JSON Lines output is read back and checked member by member
+    LoggerConfig conf {};
+    conf.target = LoggerTarget::FILE;
+    conf.fileSizeMax = 1024 * 1024 * 100;
+    conf.archiveFileName = "json";
+    conf.fileName = "json.log";
+    conf.format = LoggerFormat::JSON;
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    conf.logDirPath = currentDir;
+    RemoveLogFiles(conf.logDirPath, conf.fileName);
+    Logger* logger = Logger::GetInstance();
+    EXPECT_TRUE(logger->InitModuleSink("json", conf));
+    LoggerModule* module = logger->GetModule("json");
+    std::string escaped = "quote\" back\\slash\ttab\x01" "ctl caf\xc3\xa9";
+    MODULE_LOG_KV(module, LINFO, "request \"done\"", "user", user, "latency_us", latency, "path", escaped,
+        "ratio", 0.75, "cached", false, "region", "cn-north");
+    std::vector<std::string> lines = WaitLogLines(std::string(currentDir) + "/json.log", "latency_us", 1);
+    ASSERT_EQ(lines.size(), 1U);
+    std::vector<std::pair<std::string, std::string>> members;
+    ASSERT_TRUE(ParseJsonObject(lines[0], members)) << lines[0];
+    std::vector<std::string> keys;
+    for (const auto& member : members) {
+        keys.push_back(member.first);
+    }
+    std::vector<std::string> expectedKeys { "time", "ts", "logger", "level", "msg", "func", "line", "tid", "key",
+        "user", "latency_us", "path", "ratio", "cached", "region" };
+    ASSERT_EQ(keys, expectedKeys);
+    EXPECT_EQ(members[2].second, "\"json\"");
+    EXPECT_EQ(members[3].second, "\"INFO\"");
+    EXPECT_EQ(members[4].second, "\"request \\\"done\\\"\"");
+    EXPECT_EQ(members[9].second, "-42");
+    EXPECT_EQ(members[10].second, "1500");
+    // control characters are escaped, UTF-8 is kept as it is
+    EXPECT_EQ(members[11].second, "\"quote\\\" back\\\\slash\\ttab\\u0001ctl caf\xc3\xa9\"");
+    EXPECT_EQ(members[12].second, "0.75");
+    EXPECT_EQ(members[13].second, "false");
+    EXPECT_EQ(members[14].second, "\"cn-north\"");
+}
+
+TEST_F(LoggerTest, ThreadContext)
+{
+    std::string requestID = "req-0001";
+    LOG_CONTEXT("request_id", requestID);
+    INFOLOG("line with request id");
+    {
+        LOG_CONTEXT("tenant", "tenant-a");
+        INFOLOG("line with request id and tenant");
+    }
+    INFOLOG("line with request id only");
+    {
+        const char* missing = nullptr;
+        LOG_CONTEXT("user", missing);
+        INFOLOG("line with request id and null user");
+    }
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    std::vector<std::string> lines = WaitLogLines(std::string(currentDir) + "/" + LOGGER_FILE_NAME,
+        "line with request id", 4);
+    ASSERT_EQ(lines.size(), 4U);
+    // scoped pairs are appended in push order and removed at end of scope
+    EXPECT_NE(lines[0].find("[request_id=req-0001]"), std::string::npos) << lines[0];
+    EXPECT_NE(lines[1].find("[request_id=req-0001 tenant=tenant-a]"), std::string::npos) << lines[1];
+    EXPECT_NE(lines[2].find("[request_id=req-0001]"), std::string::npos) << lines[2];
+    // null value is taken as empty string
+    EXPECT_NE(lines[3].find("[request_id=req-0001 user=]"), std::string::npos) << lines[3];
+}
+
+TEST_F(LoggerTest, ThreadLocalKey)
+{
+    using namespace xuranus::minilogger;
+    // long key is cut to the same raw bytes in text and JSON, never in the middle of a character
+    LoggerConfig conf {};
+    conf.target = LoggerTarget::FILE;
+    conf.fileSizeMax = 1024 * 1024 * 100;
+    conf.archiveFileName = "key";
+    conf.fileName = "key.log";
+    conf.format = LoggerFormat::JSON;
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    conf.logDirPath = currentDir;
+    RemoveLogFiles(conf.logDirPath, conf.fileName);
+    Logger* logger = Logger::GetInstance();
+    EXPECT_TRUE(logger->InitModuleSink("key", conf));
+    LoggerModule* module = logger->GetModule("key");
+    std::string longKey = std::string(LOGGER_THREAD_LOCAL_KEY_MAX_LEN - 1, 'k') + "\xc3\xa9" + std::string(10, 'x');
+    std::string controlKey(200, '\x01');
+    std::thread([&]() {
+        logger->SetThreadLocalKey(longKey);
+        INFOLOG("long thread key");
+        MODULE_LOG(module, LINFO, "long thread key");
+        logger->SetThreadLocalKey(controlKey);
+        MODULE_LOG(module, LINFO, "control thread key");
+    }).join();
+    std::string expectedKey(LOGGER_THREAD_LOCAL_KEY_MAX_LEN - 1, 'k');
+    std::vector<std::string> lines = WaitLogLines(std::string(currentDir) + "/" + LOGGER_FILE_NAME,
+        "long thread key", 1);
+    ASSERT_EQ(lines.size(), 1U);
+    EXPECT_NE(lines[0].find("][" + expectedKey + "]"), std::string::npos) << lines[0];
+    lines = WaitLogLines(std::string(currentDir) + "/key.log", "thread key", 2);
+    ASSERT_EQ(lines.size(), 2U);
+    std::string escapedKey;
+    for (std::size_t i = 0; i < controlKey.length(); i++) {
+        escapedKey += "\\u0001";
+    }
+    std::vector<std::string> expectedKeys { "\"" + expectedKey + "\"", "\"" + escapedKey + "\"" };
+    for (std::size_t i = 0; i < lines.size(); i++) {
+        std::vector<std::pair<std::string, std::string>> members;
+        ASSERT_TRUE(ParseJsonObject(lines[i], members)) << lines[i];
+        auto key = std::find_if(members.begin(), members.end(),
+            [](const std::pair<std::string, std::string>& member) { return member.first == "key"; });
+        ASSERT_NE(key, members.end());
+        EXPECT_EQ(key->second, expectedKeys[i]);
+    }
+}
+
+TEST_F(LoggerTest, ModuleLogger)
+{
+    using namespace xuranus::minilogger;
+    Logger* logger = Logger::GetInstance();
+    LoggerModule* net = logger->GetModule("net");
+    LoggerModule* rpc = logger->GetModule("net.rpc");
+    EXPECT_EQ(rpc, logger->GetModule("net.rpc"));
+    EXPECT_TRUE(rpc->ShouldKeepLog(LoggerLevel::DEBUG));
+    // child inherits level from parent
+    logger->SetModuleLogLevel("net", LoggerLevel::WARNING);
+    EXPECT_FALSE(rpc->ShouldKeepLog(LoggerLevel::INFO));
+    EXPECT_TRUE(rpc->ShouldKeepLog(LoggerLevel::ERROR));
+    // child override
+    logger->SetModuleLogLevel("net.rpc", LoggerLevel::DEBUG);
+    EXPECT_TRUE(rpc->ShouldKeepLog(LoggerLevel::DEBUG));
+    EXPECT_FALSE(net->ShouldKeepLog(LoggerLevel::INFO));
+    logger->ResetModuleLogLevel("net.rpc");
+    EXPECT_FALSE(rpc->ShouldKeepLog(LoggerLevel::INFO));
+    MODULE_LOG(rpc, LERR, "rpc error %d", 1);
+    MINI_MODULE_LOG(rpc, LDBG) << "filtered by module level";
+    logger->ResetModuleLogLevel("net");
+    EXPECT_TRUE(rpc->ShouldKeepLog(LoggerLevel::DEBUG));
+
+    // dedicated sink for noisy module
+    LoggerConfig conf {};
+    conf.target = LoggerTarget::FILE;
+    conf.fileSizeMax = 1024 * 1024;
+    conf.archiveFileName = "audit.log";
+    conf.fileName = "audit.log";
+    conf.bufferSize = 1024 * 1024;
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    conf.logDirPath = currentDir;
+    EXPECT_TRUE(logger->InitModuleSink("audit", conf));
+    LoggerModule* audit = logger->GetModule("audit.login");
+    MODULE_LOG_KV(audit, LINFO, "user login", "user", "alice");
+}
+
+// run in a child process by death test, root logger of test process writes text format
+static int RunJsonRootLogger(const std::string& dirPath, const std::string& fileName)
+{
+    using namespace xuranus::minilogger;
+    LoggerConfig conf {};
+    conf.target = LoggerTarget::FILE;
+    conf.fileSizeMax = 1024 * 1024 * 100; // 100MB
+    conf.archiveFileName = fileName;
+    conf.fileName = fileName;
+    conf.logDirPath = dirPath;
+    conf.format = LoggerFormat::JSON;
+    Logger* logger = Logger::GetInstance();
+    logger->SetLogLevel(LoggerLevel::DEBUG);
+    if (!logger->Init(conf)) {
+        return 1;
+    }
+    LoggerModule* cache = logger->GetModule("cache.lru");
+    MODULE_LOG(cache, LINFO, "module record on root sink %d", 1);
+    MODULE_LOG_KV(cache, LWARN, "module kv record on root sink", "hit", false);
+    INFOLOG("root record on root sink");
+    logger->Destroy();
+    return 0;
+}
+
+TEST(ModuleRootSinkTest, ModuleName)
+{
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    const std::string fileName = "minilogger_root_json.log";
+    RemoveLogFiles(currentDir, fileName);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    EXPECT_EXIT(std::exit(RunJsonRootLogger(currentDir, fileName)), ::testing::ExitedWithCode(0), "");
+
+    // module without sink of its own writes to root sink under its own name
+    std::vector<std::string> lines = WaitLogLines(std::string(currentDir) + "/" + fileName, "on root sink", 3);
+    ASSERT_EQ(lines.size(), 3U);
+    auto memberOf = [](const std::string& line, const std::string& key) {
+        std::vector<std::pair<std::string, std::string>> members;
+        EXPECT_TRUE(ParseJsonObject(line, members)) << line;
+        for (const auto& member : members) {
+            if (member.first == key) {
+                return member.second;
+            }
+        }
+        return std::string();
+    };
+    EXPECT_EQ(memberOf(lines[0], "logger"), "\"cache.lru\"");
+    EXPECT_EQ(memberOf(lines[0], "msg"), "\"module record on root sink 1\"");
+    EXPECT_EQ(memberOf(lines[1], "logger"), "\"cache.lru\"");
+    EXPECT_EQ(memberOf(lines[1], "hit"), "false");
+    EXPECT_EQ(memberOf(lines[2], "logger"), "");
+}
+
+TEST_F(LoggerTest, IOUringBackend)
+{
+    using namespace xuranus::minilogger;
+    // falls back to blocking write if io_uring is not supported
+    LoggerConfig conf {};
+    conf.target = LoggerTarget::FILE;
+    conf.fileSizeMax = 1024 * 1024 * 100;
+    conf.archiveFileName = "uring.log";
+    conf.fileName = "uring.log";
+    conf.bufferSize = 64 * 1024;
+    conf.ioBackend = LoggerIOBackend::IO_URING;
+    conf.writeQueueDepth = 4;
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    conf.logDirPath = currentDir;
+    RemoveLogFiles(conf.logDirPath, conf.fileName);
+    Logger* logger = Logger::GetInstance();
+    EXPECT_TRUE(logger->InitModuleSink("uring", conf));
+    LoggerModule* module = logger->GetModule("uring");
+    const int threadsNum = 4;
+    const int recordsNum = 10000;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadsNum; i++) {
+        threads.emplace_back([module, i]() {
+            for (int j = 0; j < recordsNum; j++) {
+                MODULE_LOG(module, LINFO, "thread %d record %d", i, j);
+            }
+        });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    // buffers written out of order by io_uring land at their own offsets, each record exactly once in order
+    std::vector<std::string> lines = WaitLogLines(std::string(currentDir) + "/uring.log", " record ",
+        threadsNum * recordsNum);
+    ASSERT_EQ(lines.size(), static_cast<std::size_t>(threadsNum * recordsNum));
+    std::vector<int> next(threadsNum, 0);
+    for (const std::string& line : lines) {
+        int thread = -1;
+        int record = -1;
+        std::size_t pos = line.find("][thread ");
+        ASSERT_NE(pos, std::string::npos) << line;
+        ASSERT_EQ(std::sscanf(line.c_str() + pos, "][thread %d record %d]", &thread, &record), 2) << line;
+        ASSERT_TRUE(thread >= 0 && thread < threadsNum) << line;
+        EXPECT_EQ(record, next[thread]) << line;
+        next[thread] = record + 1;
+    }
+}
+
+TEST_F(LoggerTest, LogRotation)
+{
+    using namespace xuranus::minilogger;
+    // rotate by size several times, next log file is prepared and rotated files are archived in background
+    LoggerConfig conf {};
+    conf.target = LoggerTarget::FILE;
+    conf.fileSizeMax = 64 * 1024;
+    conf.archiveFilesNumMax = 100;
+    conf.archiveFileName = "rotate";
+    conf.fileName = "rotate.log";
+    conf.bufferSize = 16 * 1024;
+    conf.rotationPeriod = LoggerRotationPeriod::HOURLY;
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    conf.logDirPath = currentDir;
+    RemoveLogFiles(conf.logDirPath, conf.archiveFileName);
+    Logger* logger = Logger::GetInstance();
+    EXPECT_TRUE(logger->InitModuleSink("rotate", conf));
+    LoggerModule* module = logger->GetModule("rotate");
+    const int recordsNum = 10000;
+    for (int i = 0; i < recordsNum; i++) {
+        MODULE_LOG(module, LINFO, "rotate record %d", i);
+    }
+    // no record is lost or duplicated across archived files and current log file
+    std::vector<int> counts;
+    int archives = 0;
+    int lines = 0;
+    for (int retry = 0; retry < 50 && lines != recordsNum; retry++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        counts.assign(recordsNum, 0);
+        archives = 0;
+        lines = 0;
+        std::vector<std::string> paths;
+        for (const std::string& name : ListLogFiles(conf.logDirPath, conf.archiveFileName + ".")) {
+            if (name.find(".zip") == name.length() - 4) {
+                paths.push_back(std::string(currentDir) + "/" + name);
+                archives++;
+            }
+        }
+        // index of current log file is incomplete until its last block is closed, read it as it is
+        std::ifstream current(std::string(currentDir) + "/" + conf.fileName);
+        std::vector<std::string> contents(1, std::string(std::istreambuf_iterator<char>(current), {}));
+        for (const std::string& path : paths) {
+            contents.emplace_back();
+            ReadLogRange(path, 0, std::numeric_limits<uint64_t>::max(), contents.back());
+        }
+        for (const std::string& content : contents) {
+            std::istringstream stream(content);
+            std::string line;
+            while (std::getline(stream, line)) {
+                std::size_t pos = line.find("rotate record ");
+                int index = pos == std::string::npos ? -1 : std::atoi(line.c_str() + pos + 14);
+                if (index >= 0 && index < recordsNum) {
+                    counts[index]++;
+                    lines++;
+                }
+            }
+        }
+    }
+    EXPECT_GE(archives, 5);
+    ASSERT_EQ(lines, recordsNum);
+    for (int i = 0; i < recordsNum; i++) {
+        EXPECT_EQ(counts[i], 1) << "rotate record " << i;
+    }
+}
+
+#ifndef _WIN32
+TEST_F(LoggerTest, SharedMemoryWriter)
+{
+    using namespace xuranus::minilogger;
+    // producer process exits without Destroy(), its records are drained from shm by the writer started later
+    const std::string shmName = "/minilogger_test_" + std::to_string(::getpid());
+    const int recordsNum = 1000;
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    RemoveLogFiles(currentDir, "shm.log");
+    // thread id of forking thread is cached before fork, child must not report it
+    INFOLOG("fork shared memory producer");
+    pid_t pid = ::fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        LoggerConfig conf {};
+        conf.target = LoggerTarget::SHARED_MEMORY;
+        conf.shmName = shmName;
+        conf.shmRingNum = 4;
+        conf.shmRingSize = 256 * 1024;
+        Logger* logger = Logger::GetInstance();
+        if (!logger->InitModuleSink("shm", conf)) {
+            ::_exit(1);
+        }
+        LoggerModule* module = logger->GetModule("shm");
+        for (int i = 0; i < recordsNum; i++) {
+            MODULE_LOG(module, LINFO, "shm record %d", i);
+        }
+        // large payload is counted before it's encoded once
+        std::vector<unsigned char> blob(8 * 1024, 0xAB);
+        MODULE_LOG_KV(module, LINFO, "shm payload", "payload", LoggerHex(blob.data(), blob.size()));
+        // never fits in a ring, reported by writer instead
+        std::string oversized(conf.shmRingSize, 'x');
+        MODULE_LOG_KV(module, LINFO, "oversized", "payload", oversized);
+        ::_exit(0);
+    }
+    int status = 0;
+    ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    LoggerConfig conf {};
+    conf.target = LoggerTarget::FILE;
+    conf.fileSizeMax = 1024 * 1024 * 100;
+    conf.archiveFileName = "shm";
+    conf.fileName = "shm.log";
+    conf.bufferSize = 64 * 1024;
+    conf.shmName = shmName;
+    conf.logDirPath = currentDir;
+    EXPECT_TRUE(Logger::GetInstance()->InitModuleSink("shm", conf));
+    // buffer is written by consumer thread periodically
+    std::vector<std::string> lines = WaitLogLines(std::string(currentDir) + "/shm.log", "shm record", recordsNum);
+    ASSERT_EQ(lines.size(), static_cast<std::size_t>(recordsNum));
+    // records are tagged with producer process, and the thread id of child itself
+    const std::string producer = "[" + std::to_string(pid) + ":" + std::to_string(pid) + "]";
+    for (int i = 0; i < recordsNum; i++) {
+        EXPECT_NE(lines[i].find("[shm record " + std::to_string(i) + "]"), std::string::npos) << lines[i];
+        EXPECT_NE(lines[i].find(producer), std::string::npos) << lines[i];
+    }
+    std::vector<std::string> payload = WaitLogLines(std::string(currentDir) + "/shm.log", "shm payload", 1);
+    ASSERT_EQ(payload.size(), 1U);
+    std::string hex;
+    for (int i = 0; i < 8 * 1024; i++) {
+        hex += "ab";
+    }
+    EXPECT_NE(payload[0].find("[shm payload payload=" + hex + "]"), std::string::npos);
+    const std::string dropped = "1 records of process " + std::to_string(pid) + " dropped";
+    EXPECT_EQ(WaitLogLines(std::string(currentDir) + "/shm.log", dropped, 1).size(), 1U);
+    ::shm_unlink(shmName.c_str());
+}
+#endif
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+TEST_F(LoggerTest, CrashHandler)
+{
+    using namespace xuranus::minilogger;
+    // records still in buffer are written by crash handler, then the default action terminates the process.
+    // Consumer thread is busy writing small buffers at the time, each record is still written exactly once
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    const std::string logFilePath = std::string(currentDir) + "/crash.log";
+    const int recordsNum = 1000;
+    const int runsNum = 20;
+    for (int run = 0; run < runsNum; run++) {
+        RemoveLogFiles(currentDir, "crash.log");
+        pid_t pid = ::fork();
+        ASSERT_GE(pid, 0);
+        if (pid == 0) {
+            LoggerConfig conf {};
+            conf.target = LoggerTarget::FILE;
+            conf.fileSizeMax = 1024 * 1024 * 100;
+            conf.archiveFileName = "crash";
+            conf.fileName = "crash.log";
+            conf.bufferSize = 4 * 1024;
+            conf.crashHandler = true;
+            conf.logDirPath = currentDir;
+            Logger* logger = Logger::GetInstance();
+            if (!logger->InitModuleSink("crash", conf)) {
+                ::_exit(1);
+            }
+            LoggerModule* module = logger->GetModule("crash");
+            for (int i = 0; i < recordsNum; i++) {
+                MODULE_LOG(module, LINFO, "crash record %d", i);
+            }
+            std::abort();
+        }
+        int status = 0;
+        ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+        EXPECT_TRUE(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT) << "run " << run;
+        // records in order, followed by stack trace
+        std::ifstream file(logFilePath);
+        std::string line;
+        std::vector<int> indexes;
+        bool stackTrace = false;
+        while (std::getline(file, line)) {
+            std::size_t pos = line.find("crash record ");
+            if (pos != std::string::npos) {
+                EXPECT_FALSE(stackTrace) << "run " << run << ": " << line;
+                indexes.push_back(std::atoi(line.c_str() + pos + 13));
+            }
+            stackTrace = stackTrace || line.find("caught signal") != std::string::npos;
+        }
+        ASSERT_EQ(indexes.size(), static_cast<std::size_t>(recordsNum)) << "run " << run;
+        for (int i = 0; i < recordsNum; i++) {
+            ASSERT_EQ(indexes[i], i) << "run " << run;
+        }
+        EXPECT_TRUE(stackTrace) << "run " << run;
+    }
+}
+
+static int OverflowStack(int depth)
+{
+    volatile char frame[1024];
+    frame[0] = static_cast<char>(depth);
+    return OverflowStack(depth + 1) + frame[0];
+}
+
+TEST_F(LoggerTest, CrashOnStackOverflow)
+{
+    using namespace xuranus::minilogger;
+    // crash handler runs on alternate signal stack of a logging thread whose own stack is exhausted
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    RemoveLogFiles(currentDir, "overflow.log");
+    pid_t pid = ::fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        LoggerConfig conf {};
+        conf.target = LoggerTarget::FILE;
+        conf.fileSizeMax = 1024 * 1024 * 100;
+        conf.archiveFileName = "overflow";
+        conf.fileName = "overflow.log";
+        conf.crashHandler = true;
+        conf.logDirPath = currentDir;
+        Logger* logger = Logger::GetInstance();
+        if (!logger->InitModuleSink("overflow", conf)) {
+            ::_exit(1);
+        }
+        LoggerModule* module = logger->GetModule("overflow");
+        std::thread([&]() {
+            MODULE_LOG(module, LINFO, "record before stack overflow");
+            OverflowStack(0);
+        }).join();
+        ::_exit(2);
+    }
+    int status = 0;
+    ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+    EXPECT_TRUE(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV) << status;
+    std::ifstream file(std::string(currentDir) + "/overflow.log");
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_NE(content.find("record before stack overflow"), std::string::npos);
+    EXPECT_NE(content.find("caught signal 11"), std::string::npos);
+}
+
+TEST_F(LoggerTest, CrashSinkLimit)
+{
+    using namespace xuranus::minilogger;
+    // a sink asking for crash handling is rejected once crash handler can not flush more sinks
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    RemoveLogFiles(currentDir, "limit");
+    pid_t pid = ::fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        Logger* logger = Logger::GetInstance();
+        int inited = 0;
+        for (int i = 0; i <= 16; i++) {
+            LoggerConfig conf {};
+            conf.target = LoggerTarget::FILE;
+            conf.fileSizeMax = 1024 * 1024;
+            conf.archiveFileName = "limit" + std::to_string(i);
+            conf.fileName = "limit" + std::to_string(i) + ".log";
+            conf.bufferSize = 4 * 1024;
+            conf.crashHandler = true;
+            conf.logDirPath = currentDir;
+            inited += logger->InitModuleSink("limit" + std::to_string(i), conf) ? 1 : 0;
+        }
+        ::_exit(inited == 16 ? 0 : 1);
+    }
+    int status = 0;
+    ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    RemoveLogFiles(currentDir, "limit");
+}
+#endif
+
+TEST_F(LoggerTest, ShardedSink)
+{
+    using namespace xuranus::minilogger;
+    // each producer thread sticks to one of shard.log.0 and shard.log.1
+    LoggerConfig conf {};
+    conf.target = LoggerTarget::FILE;
+    conf.fileSizeMax = 1024 * 1024 * 100;
+    conf.archiveFileName = "shard";
+    conf.fileName = "shard.log";
+    conf.bufferSize = 64 * 1024;
+    conf.shardNum = 2;
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    conf.logDirPath = currentDir;
+    RemoveLogFiles(conf.logDirPath, conf.fileName);
+    Logger* logger = Logger::GetInstance();
+    EXPECT_TRUE(logger->InitModuleSink("shard", conf));
+    LoggerModule* module = logger->GetModule("shard");
+    const int threadsNum = 4;
+    const int recordsNum = 1000;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadsNum; i++) {
+        threads.emplace_back([module, i]() {
+            for (int j = 0; j < recordsNum; j++) {
+                MODULE_LOG(module, LINFO, "shard thread %d record %d", i, j);
+            }
+        });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    // buffer is written by consumer thread periodically
+    std::vector<int> lines(conf.shardNum, 0);
+    for (int retry = 0; retry < 50 && lines[0] + lines[1] < threadsNum * recordsNum; retry++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        for (uint32_t shard = 0; shard < conf.shardNum; shard++) {
+            std::ifstream file(std::string(currentDir) + "/shard.log." + std::to_string(shard));
+            std::string line;
+            lines[shard] = 0;
+            while (std::getline(file, line)) {
+                lines[shard]++;
+            }
+        }
+    }
+    EXPECT_EQ(lines[0] + lines[1], threadsNum * recordsNum);
+    EXPECT_GT(lines[0], 0);
+    EXPECT_GT(lines[1], 0);
+}
+
+TEST_F(LoggerTest, LargePayload)
+{
+    using namespace xuranus::minilogger;
+    // payloads beyond 4KB are kept whole, the hex blob is even larger than the whole buffer
+    LoggerConfig conf {};
+    conf.target = LoggerTarget::FILE;
+    conf.fileSizeMax = 1024 * 1024 * 100;
+    conf.archiveFileName = "payload";
+    conf.fileName = "payload.log";
+    conf.bufferSize = 16 * 1024;
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    conf.logDirPath = currentDir;
+    RemoveLogFiles(conf.logDirPath, conf.fileName);
+    Logger* logger = Logger::GetInstance();
+    EXPECT_TRUE(logger->InitModuleSink("payload", conf));
+    LoggerModule* module = logger->GetModule("payload");
+    std::vector<unsigned char> blob(32 * 1024);
+    std::string hex;
+    for (std::size_t i = 0; i < blob.size(); i++) {
+        blob[i] = static_cast<unsigned char>(i * 7);
+        char digits[3];
+        std::snprintf(digits, sizeof(digits), "%02x", blob[i]);
+        hex += digits;
+    }
+    std::vector<unsigned char> ones(6000, 0xFF);
+    std::string base64(8000, '/');
+    std::string literal = "literal " + std::string(10000, 'x');
+    std::string formatted = "formatted " + std::string(10000, 'y') + " 42";
+    MODULE_LOG(module, LINFO, "before payload");
+    MODULE_LOG_KV(module, LINFO, "packet", "payload", LoggerHex(blob.data(), blob.size()), "tail", 1);
+    MODULE_LOG_KV(module, LINFO, "packet", "payload", LoggerBase64(ones.data(), ones.size()), "tail", 1);
+    MODULE_LOG(module, LINFO, literal.c_str());
+    MODULE_LOG(module, LINFO, "formatted %s %d", std::string(10000, 'y').c_str(), 42);
+    MODULE_LOG(module, LINFO, "after payload");
+    bool foundHex = false;
+    bool foundBase64 = false;
+    bool foundLiteral = false;
+    bool foundFormatted = false;
+    int lines = 0;
+    for (int retry = 0; retry < 50 && lines < 6; retry++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::ifstream file(std::string(currentDir) + "/payload.log");
+        std::string line;
+        lines = 0;
+        while (std::getline(file, line)) {
+            lines++;
+            foundHex = foundHex || line.find("payload=" + hex + " tail=1") != std::string::npos;
+            foundBase64 = foundBase64 || line.find("payload=" + base64 + " tail=1") != std::string::npos;
+            foundLiteral = foundLiteral || line.find(literal) != std::string::npos;
+            foundFormatted = foundFormatted || line.find(formatted) != std::string::npos;
+        }
+    }
+    EXPECT_EQ(lines, 6);
+    EXPECT_TRUE(foundHex);
+    EXPECT_TRUE(foundBase64);
+    EXPECT_TRUE(foundLiteral);
+    EXPECT_TRUE(foundFormatted);
+}
+
+TEST(LogIndexTest, LookupLogRange)
+{
+    using namespace xuranus::minilogger;
+    std::vector<LogIndexEntry> entries(4);
+    for (std::size_t i = 0; i < entries.size(); i++) {
+        entries[i] = LogIndexEntry {};
+        entries[i].offset = i * 100;
+        entries[i].beginTime = 1000 + i * 10;
+        entries[i].endTime = 1000 + i * 10 + 9;
+    }
+    uint64_t beginOffset = 0;
+    uint64_t endOffset = 0;
+    EXPECT_TRUE(LookupLogRange(entries, 1012, 1025, beginOffset, endOffset));
+    EXPECT_EQ(beginOffset, 100);
+    EXPECT_EQ(endOffset, 300);
+    EXPECT_TRUE(LookupLogRange(entries, 1035, 2000, beginOffset, endOffset));
+    EXPECT_EQ(beginOffset, 300);
+    EXPECT_EQ(endOffset, std::numeric_limits<uint64_t>::max());
+    EXPECT_FALSE(LookupLogRange(entries, 0, 999, beginOffset, endOffset));
+}
+
+TEST_F(LoggerTest, LogIndexAcrossRotation)
+{
+    using namespace xuranus::minilogger;
+    // a time range spanning a rotation is looked up in both the archive and the log file after it
+    LoggerConfig conf {};
+    conf.target = LoggerTarget::FILE;
+    conf.fileSizeMax = 32 * 1024;
+    conf.archiveFilesNumMax = 100;
+    conf.archiveFileName = "index";
+    conf.fileName = "index.log";
+    conf.bufferSize = 8 * 1024;
+    conf.indexInterval = 1024;
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    conf.logDirPath = currentDir;
+    RemoveLogFiles(conf.logDirPath, conf.archiveFileName);
+    Logger* logger = Logger::GetInstance();
+    EXPECT_TRUE(logger->InitModuleSink("index", conf));
+    LoggerModule* module = logger->GetModule("index");
+    const int recordsNum = 1000;
+    for (int i = 0; i < recordsNum; i++) {
+        MODULE_LOG(module, LINFO, "index record %d", i);
+    }
+    // archived files in rotation order followed by current log file, wait until all of them are complete
+    std::vector<std::string> paths;
+    std::vector<std::string> contents;
+    int lines = 0;
+    for (int retry = 0; retry < 50 && lines != recordsNum; retry++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        paths.clear();
+        contents.clear();
+        lines = 0;
+        for (const std::string& name : ListLogFiles(conf.logDirPath, conf.archiveFileName + ".")) {
+            if (name.find(".zip") == name.length() - 4) {
+                paths.push_back(std::string(currentDir) + "/" + name);
+            }
+        }
+        paths.push_back(std::string(currentDir) + "/" + conf.fileName);
+        for (const std::string& path : paths) {
+            contents.emplace_back();
+            ReadLogRange(path, 0, std::numeric_limits<uint64_t>::max(), contents.back());
+            lines += static_cast<int>(std::count(contents.back().begin(), contents.back().end(), '\n'));
+        }
+    }
+    ASSERT_EQ(lines, recordsNum);
+    ASSERT_GE(paths.size(), 3U);
+    // every index entry points at the beginning of a record
+    for (std::size_t i = 0; i < paths.size(); i++) {
+        std::vector<LogIndexEntry> entries;
+        ASSERT_TRUE(LoadLogIndex(paths[i], entries)) << paths[i];
+        ASSERT_FALSE(entries.empty()) << paths[i];
+        for (const LogIndexEntry& entry : entries) {
+            ASSERT_LT(entry.offset, contents[i].length()) << paths[i];
+            EXPECT_TRUE(entry.offset == 0 || contents[i][entry.offset - 1] == '\n') << paths[i];
+            EXPECT_EQ(contents[i][entry.offset], '[') << paths[i];
+        }
+    }
+    // last records of the second file and first records of the third one
+    auto lineTime = [](const std::string& line) {
+        std::time_t seconds = 0;
+        int micros = 0;
+        EXPECT_TRUE(ParseLineTime(line, seconds, micros)) << line;
+        return static_cast<uint64_t>(seconds) * 1000000 + static_cast<uint64_t>(micros);
+    };
+    const std::string& before = contents[1];
+    const std::string& after = contents[2];
+    std::size_t lastLine = before.rfind('\n', before.length() - 2) + 1;
+    uint64_t beginTime = lineTime(before.substr(lastLine));
+    uint64_t endTime = lineTime(after);
+    std::string rangeBefore;
+    std::string rangeAfter;
+    ASSERT_TRUE(ReadLogRange(paths[1], beginTime, endTime, rangeBefore));
+    ASSERT_TRUE(ReadLogRange(paths[2], beginTime, endTime, rangeAfter));
+    // index blocks are coarse, the range may start earlier but always covers the boundary records
+    ASSERT_FALSE(rangeBefore.empty());
+    ASSERT_FALSE(rangeAfter.empty());
+    EXPECT_EQ(rangeBefore.front(), '[');
+    EXPECT_EQ(before.compare(before.length() - rangeBefore.length(), rangeBefore.length(), rangeBefore), 0);
+    EXPECT_EQ(after.compare(0, after.find('\n') + 1, rangeAfter, 0, after.find('\n') + 1), 0);
+}
+
+#if defined(MINILOGGER_QUERY_TOOL_PATH) && !defined(_WIN32)
+namespace {
+    // run minilogger_query with arguments, return what it prints
+    std::string RunQueryTool(const std::string& args)
+    {
+        std::string output;
+        FILE* pipe = ::popen((std::string(MINILOGGER_QUERY_TOOL_PATH) + " " + args).c_str(), "r");
+        if (pipe == nullptr) {
+            return output;
+        }
+        char buffer[4096];
+        std::size_t length = 0;
+        while ((length = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+            output.append(buffer, length);
+        }
+        ::pclose(pipe);
+        return output;
+    }
+}
+
+TEST_F(LoggerTest, QueryTool)
+{
+    using namespace xuranus::minilogger;
+    // archives are listed in rotation order followed by current log file
+    LoggerConfig conf {};
+    conf.target = LoggerTarget::FILE;
+    conf.fileSizeMax = 16 * 1024;
+    conf.archiveFilesNumMax = 100;
+    conf.archiveFileName = "query";
+    conf.fileName = "query.log";
+    conf.bufferSize = 8 * 1024;
+    conf.indexInterval = 1024;
+    char currentDir[FILENAME_MAX];
+    ASSERT_NE(GetCurrentDir(currentDir, sizeof(currentDir)), nullptr);
+    conf.logDirPath = currentDir;
+    RemoveLogFiles(conf.logDirPath, conf.archiveFileName);
+    Logger* logger = Logger::GetInstance();
+    EXPECT_TRUE(logger->InitModuleSink("query", conf));
+    LoggerModule* module = logger->GetModule("query");
+    const int recordsNum = 600;
+    for (int i = 0; i < recordsNum; i++) {
+        MODULE_LOG(module, LINFO, "query record %d", i);
+    }
+    std::string args = "--dir " + std::string(currentDir) + " --name query.log --archive query --grep \"query record\"";
+    std::vector<std::string> lines;
+    for (int retry = 0; retry < 50 && lines.size() != recordsNum; retry++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::istringstream output(RunQueryTool(args));
+        lines.clear();
+        for (std::string line; std::getline(output, line);) {
+            lines.push_back(line);
+        }
+    }
+    ASSERT_EQ(lines.size(), static_cast<std::size_t>(recordsNum));
+    for (int i = 0; i < recordsNum; i++) {
+        EXPECT_NE(lines[i].find("[query record " + std::to_string(i) + "]"), std::string::npos) << lines[i];
+    }
+    std::size_t archivesNum = 0;
+    for (const std::string& name : ListLogFiles(conf.logDirPath, "query.")) {
+        archivesNum += name.find(".zip") == name.length() - 4 ? 1 : 0;
+    }
+    EXPECT_GE(archivesNum, 2U);
+
+    // time range is narrowed by sidecar index, a record outside the indexed block is not scanned
+    const std::string path = std::string(currentDir) + "/narrow.log";
+    const char* records[] = {
+        "[2023-06-23 10:00:01.000000][INFO][record a][f():1][1][]\n",
+        "[2023-06-23 10:00:02.000000][INFO][record b][f():1][1][]\n",
+        "[2023-06-23 10:00:03.000000][INFO][record c][f():1][1][]\n",
+        "[2023-06-23 10:00:02.500000][INFO][record d][f():1][1][]\n"
+    };
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    std::vector<LogIndexEntry> entries;
+    uint64_t offset = 0;
+    for (std::size_t i = 0; i < 4; i++) {
+        std::time_t seconds = 0;
+        int micros = 0;
+        ASSERT_TRUE(ParseLineTime(records[i], seconds, micros));
+        uint64_t timestamp = static_cast<uint64_t>(seconds) * 1000000 + static_cast<uint64_t>(micros);
+        if (i < 3) {
+            // the straggler d is left in block of c
+            LogIndexEntry entry {};
+            entry.offset = offset;
+            entry.beginTime = timestamp;
+            entry.endTime = timestamp;
+            entries.push_back(entry);
+        }
+        file << records[i];
+        offset += std::strlen(records[i]);
+    }
+    file.close();
+    const char magic[8] = { 'M', 'L', 'I', 'D', 'X', '\0', '\0', '\1' };
+    std::ofstream indexFile(path + ".idx", std::ios::binary | std::ios::trunc);
+    indexFile.write(magic, sizeof(magic));
+    indexFile.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(LogIndexEntry));
+    indexFile.close();
+    std::string range = "--from \"2023-06-23 10:00:02\" --to \"2023-06-23 10:00:02\" " + path;
+    EXPECT_EQ(RunQueryTool(range), records[1]);
+    // without index the whole file is scanned
+    std::remove((path + ".idx").c_str());
+    EXPECT_EQ(RunQueryTool(range), std::string(records[1]) + records[3]);
+
+    // shards are merged by datetime, although records of concurrent threads are not ordered in a shard
+    const char* shardRecords[2][3] = {
+        {
+            "[2023-06-23 10:00:01.000000][INFO][merge 0][f():1][1][]\n",
+            "[2023-06-23 10:00:04.000000][INFO][merge 3][f():1][1][]\n",
+            "[2023-06-23 10:00:03.000000][INFO][merge 2][f():1][2][]\n"
+        },
+        {
+            "[2023-06-23 10:00:02.000000][INFO][merge 1][f():1][3][]\n",
+            "[2023-06-23 10:00:06.000000][INFO][merge 5][f():1][3][]\n",
+            "[2023-06-23 10:00:05.000000][INFO][merge 4][f():1][4][]\n"
+        }
+    };
+    RemoveLogFiles(currentDir, "merge.log");
+    for (int shard = 0; shard < 2; shard++) {
+        std::ofstream shardFile(std::string(currentDir) + "/merge.log." + std::to_string(shard), std::ios::binary);
+        for (const char* record : shardRecords[shard]) {
+            shardFile << record;
+        }
+    }
+    std::istringstream merged(RunQueryTool("--dir " + std::string(currentDir) + " --name merge.log --shards 2"));
+    int mergedNum = 0;
+    for (std::string line; std::getline(merged, line); mergedNum++) {
+        EXPECT_NE(line.find("[merge " + std::to_string(mergedNum) + "]"), std::string::npos) << line;
+    }
+    EXPECT_EQ(mergedNum, 6);
+}
+#endif
+
 TEST_F(LoggerTest, LoggerGuard)
 {
     INFOLOG_GUARD;
@@ -83,6 +1149,37 @@ TEST_F(LoggerTest, LoggerGuard)
     ERRLOG("line2");
 }
 
+static void ProfiledScope(int i)
+{
+    INFOLOG_GUARD;
+    if (i % 10 == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+TEST_F(LoggerTest, ScopeProfile)
+{
+    using namespace xuranus::minilogger;
+    Logger::GetInstance()->SetGuardMode(LoggerGuardMode::PROFILE);
+    for (int i = 0; i < 100; i++) {
+        ProfiledScope(i);
+    }
+    Logger::GetInstance()->SetGuardMode(LoggerGuardMode::ELAPSED);
+    ProfiledScope(1);
+    Logger::GetInstance()->SetGuardMode(LoggerGuardMode::TRACE);
+    std::vector<LoggerScopeStat> stats = CollectScopeProfiles();
+    auto it = std::find_if(stats.begin(), stats.end(), [](const LoggerScopeStat& stat) {
+        return stat.function.find("ProfiledScope") != std::string::npos;
+    });
+    ASSERT_NE(it, stats.end());
+    EXPECT_EQ(it->count, 101);
+    EXPECT_GE(it->maxNanos, 1000000);
+    EXPECT_LE(it->minNanos, it->p50Nanos);
+    EXPECT_LE(it->p50Nanos, it->p99Nanos);
+    EXPECT_LE(it->p99Nanos, it->maxNanos);
+    DumpScopeProfiles(10);
+}
+
 static void LogProducerThread(int lineCounter)
 {
     const char* str1 = "hello world hello world";
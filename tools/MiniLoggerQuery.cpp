@@ -0,0 +1,739 @@
+/*================================================================
+*   Copyright (C) 2023 XUranus All rights reserved.
+*   
+*   File:         MiniLoggerQuery.cpp
+*   Author:       XUranus
+*   Date:         2023-06-23
+*   Description:  query records from current log and archives in parallel
+*
+================================================================*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <regex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <limits>
+
+#include <zip.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MINILOGGER_QUERY_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "../Logger.h"
+
+using namespace xuranus::minilogger;
+
+namespace {
+    const std::size_t CHUNK_SIZE = 8 * ONE_MB;
+    const char* LEVEL_NAMES[LOGGER_LEVEL_NUM] = { "DBG", "INFO", "WARN", "ERR", "FATAL" };
+    const std::string ARCHIVE_FILE_EXTENSION = ".zip";
+    const std::string TEMP_FILE_EXTENSION = ".tmp";
+    // rotation stamp YYYYmmdd-HHMMSS.NNN
+    const std::size_t ROTATION_STAMP_LENGTH = 19;
+}
+
+/**
+ * @brief find first byte c in [begin, end), scan 16 bytes at a time with SSE2
+ */
+static const char* FindByte(const char* begin, const char* end, char c)
+{
+#ifdef MINILOGGER_QUERY_SSE2
+    const __m128i pattern = _mm_set1_epi8(c);
+    while (end - begin >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern));
+        if (mask != 0) {
+#ifdef _MSC_VER
+            unsigned long index = 0;
+            _BitScanForward(&index, static_cast<unsigned long>(mask));
+            return begin + index;
+#else
+            return begin + __builtin_ctz(static_cast<unsigned int>(mask));
+#endif
+        }
+        begin += 16;
+    }
+#endif
+    const void* found = std::memchr(begin, c, end - begin);
+    return found == nullptr ? end : static_cast<const char*>(found);
+}
+
+/**
+ * @brief find needle in [begin, end), candidates are located by vectorized scan of the first byte
+ */
+static const char* FindString(const char* begin, const char* end, const std::string& needle)
+{
+    if (needle.empty()) {
+        return begin;
+    }
+    // compare lengths before forming any pointer, so it never points out of [begin, end]
+    std::size_t length = static_cast<std::size_t>(end - begin);
+    if (length < needle.length()) {
+        return end;
+    }
+    // last position a match can start at, plus one
+    const char* last = begin + (length - needle.length() + 1);
+    while (begin < last) {
+        begin = FindByte(begin, last, needle[0]);
+        if (begin == last) {
+            break;
+        }
+        if (std::memcmp(begin, needle.data(), needle.length()) == 0) {
+            return begin;
+        }
+        begin++;
+    }
+    return end;
+}
+
+// find last "][" in [begin, end)
+static const char* FindFieldSeparatorBackward(const char* begin, const char* end)
+{
+    for (std::ptrdiff_t i = end - begin - 1; i > 0; i--) {
+        if (begin[i] == '[' && begin[i - 1] == ']') {
+            return begin + i - 1;
+        }
+    }
+    return nullptr;
+}
+
+struct StringRef {
+    const char*     data { nullptr };
+    std::size_t     length { 0 };
+
+    StringRef() = default;
+
+    StringRef(const char* str, std::size_t len) : data(str), length(len)
+    {}
+
+    bool Contains(const std::string& str) const
+    {
+        return FindString(data, data + length, str) != data + length;
+    }
+};
+
+/**
+ * @brief fields of a text record [datetime][level][message][function:line][threadID][threadLocalKey]
+ */
+struct LogLine {
+    StringRef   datetime;
+    StringRef   level;
+    StringRef   message;
+    StringRef   function;
+    StringRef   threadID;
+    StringRef   threadLocalKey;
+};
+
+/**
+ * @brief split a line into fields, head fields are located from begin and tail fields from end
+ * since message may contain any character
+ */
+static bool ParseLogLine(const char* begin, const char* end, LogLine& line)
+{
+    if (end > begin && *(end - 1) == '\r') {
+        end--;
+    }
+    if (end - begin < 2 || *begin != '[' || *(end - 1) != ']') {
+        return false;
+    }
+    const char* datetimeEnd = FindByte(begin + 1, end, ']');
+    if (datetimeEnd == end || datetimeEnd + 1 == end || *(datetimeEnd + 1) != '[') {
+        return false;
+    }
+    const char* levelBegin = datetimeEnd + 2;
+    const char* levelEnd = FindByte(levelBegin, end, ']');
+    if (end - levelEnd < 2) {
+        return false;
+    }
+    const char* messageBegin = levelEnd + 2;
+    const char* keySep = FindFieldSeparatorBackward(messageBegin, end - 1);
+    const char* threadSep = keySep == nullptr ? nullptr : FindFieldSeparatorBackward(messageBegin, keySep);
+    const char* functionSep = threadSep == nullptr ? nullptr : FindFieldSeparatorBackward(messageBegin, threadSep);
+    if (functionSep == nullptr || functionSep < messageBegin) {
+        return false;
+    }
+    line.datetime = StringRef { begin + 1, static_cast<std::size_t>(datetimeEnd - begin - 1) };
+    line.level = StringRef { levelBegin, static_cast<std::size_t>(levelEnd - levelBegin) };
+    line.message = StringRef { messageBegin, static_cast<std::size_t>(functionSep - messageBegin) };
+    line.function = StringRef { functionSep + 2, static_cast<std::size_t>(threadSep - functionSep - 2) };
+    line.threadID = StringRef { threadSep + 2, static_cast<std::size_t>(keySep - threadSep - 2) };
+    line.threadLocalKey = StringRef { keySep + 2, static_cast<std::size_t>(end - 1 - keySep - 2) };
+    return true;
+}
+
+struct QueryOptions {
+    std::string                 from;           // datetime prefix, inclusive
+    std::string                 to;             // datetime prefix, inclusive
+    int                         minLevel { 0 };
+    std::string                 function;
+    std::string                 threadID;
+    std::string                 key;
+    std::string                 substring;
+    std::unique_ptr<std::regex> regex;
+    uint32_t                    threads { 0 };
+    std::vector<std::string>    paths;
+    // shards of a logger, matched records of all sources are merged by datetime if it's not 0
+    uint32_t                    shards { 0 };
+    // merge group of each path, files of a shard form one group and any other file forms its own
+    std::vector<uint32_t>       pathGroups;
+    uint32_t                    groupsNum { 0 };
+};
+
+static int ParseLevel(const StringRef& level)
+{
+    for (uint32_t i = 0; i < LOGGER_LEVEL_NUM; i++) {
+        if (level.length == std::strlen(LEVEL_NAMES[i]) && std::memcmp(level.data, LEVEL_NAMES[i], level.length) == 0) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+// compare first prefix.length() bytes of str with prefix
+static int ComparePrefix(const StringRef& str, const std::string& prefix)
+{
+    int ret = std::memcmp(str.data, prefix.data(), std::min(str.length, prefix.length()));
+    if (ret == 0 && str.length < prefix.length()) {
+        return -1;
+    }
+    return ret;
+}
+
+static bool MatchLine(const QueryOptions& options, const LogLine& line)
+{
+    // datetime is fixed width, so lexicographical order is chronological order
+    if (!options.from.empty() && ComparePrefix(line.datetime, options.from) < 0) {
+        return false;
+    }
+    if (!options.to.empty() && ComparePrefix(line.datetime, options.to) > 0) {
+        return false;
+    }
+    if (options.minLevel > 0 && ParseLevel(line.level) < options.minLevel) {
+        return false;
+    }
+    if (!options.threadID.empty() && (line.threadID.length != options.threadID.length() ||
+        std::memcmp(line.threadID.data, options.threadID.data(), line.threadID.length) != 0)) {
+        return false;
+    }
+    if (!options.function.empty() && !line.function.Contains(options.function)) {
+        return false;
+    }
+    if (!options.key.empty() && !line.threadLocalKey.Contains(options.key)) {
+        return false;
+    }
+    if (!options.substring.empty() && !line.message.Contains(options.substring)) {
+        return false;
+    }
+    if (options.regex && !std::regex_search(line.message.data, line.message.data + line.message.length, *options.regex)) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief content of a log file, live log is memory mapped and archive is decompressed into memory
+ */
+class LogSource {
+public:
+    explicit LogSource(const std::string& path) : m_path(path)
+    {}
+
+    ~LogSource()
+    {
+#ifndef _WIN32
+        if (m_mapped != nullptr) {
+            ::munmap(m_mapped, m_mappedLength);
+        }
+#endif
+    }
+
+    bool Load()
+    {
+        bool isArchive = m_path.length() >= ARCHIVE_FILE_EXTENSION.length() &&
+            m_path.compare(m_path.length() - ARCHIVE_FILE_EXTENSION.length(),
+                ARCHIVE_FILE_EXTENSION.length(), ARCHIVE_FILE_EXTENSION) == 0;
+        return isArchive ? LoadArchive() : LoadFile();
+    }
+
+    const char* Data() const
+    {
+        return m_data;
+    }
+
+    std::size_t Length() const
+    {
+        return m_length;
+    }
+
+    const std::string& Path() const
+    {
+        return m_path;
+    }
+
+private:
+    bool LoadFile()
+    {
+#ifdef _WIN32
+        std::ifstream file(m_path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        std::ostringstream stream;
+        stream << file.rdbuf();
+        m_content = stream.str();
+        m_data = m_content.data();
+        m_length = m_content.length();
+        return true;
+#else
+        int fd = ::open(m_path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        m_length = static_cast<std::size_t>(st.st_size);
+        if (m_length == 0) {
+            ::close(fd);
+            return true;
+        }
+        void* mapped = ::mmap(nullptr, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        ::madvise(mapped, m_length, MADV_SEQUENTIAL);
+        m_mapped = mapped;
+        m_mappedLength = m_length;
+        m_data = static_cast<const char*>(mapped);
+        return true;
+#endif
+    }
+
+    bool LoadArchive()
+    {
+        ::zip_t* archive = ::zip_open(m_path.c_str(), ZIP_RDONLY, nullptr);
+        if (archive == nullptr) {
+            return false;
+        }
+        bool loaded = false;
+        zip_int64_t entriesNum = ::zip_get_num_entries(archive, 0);
+        for (zip_int64_t i = 0; i < entriesNum && !loaded; i++) {
+            const char* name = ::zip_get_name(archive, i, 0);
+            std::string entryName = name == nullptr ? "" : name;
+            if (entryName.length() >= 4 && entryName.compare(entryName.length() - 4, 4, ".idx") == 0) {
+                continue;
+            }
+            ::zip_file_t* entry = ::zip_fopen_index(archive, i, 0);
+            if (entry == nullptr) {
+                break;
+            }
+            std::vector<char> buffer(ONE_MB);
+            zip_int64_t length = 0;
+            while ((length = ::zip_fread(entry, buffer.data(), buffer.size())) > 0) {
+                m_content.append(buffer.data(), static_cast<std::size_t>(length));
+            }
+            ::zip_fclose(entry);
+            loaded = length == 0;
+        }
+        ::zip_discard(archive);
+        m_data = m_content.data();
+        m_length = m_content.length();
+        return loaded;
+    }
+
+private:
+    std::string     m_path;
+    const char*     m_data { nullptr };
+    std::size_t     m_length { 0 };
+    std::string     m_content;
+    void*           m_mapped { nullptr };
+    std::size_t     m_mappedLength { 0 };
+};
+
+struct ScanTask {
+    std::size_t     sourceIndex;
+    const char*     begin;
+    const char*     end;
+    std::string     output;
+};
+
+static void ParallelFor(std::size_t count, uint32_t threadsNum, const std::function<void(std::size_t)>& fn)
+{
+    std::atomic<std::size_t> next { 0 };
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < std::min<std::size_t>(threadsNum, count); i++) {
+        threads.emplace_back([&]() {
+            for (std::size_t index = next++; index < count; index = next++) {
+                fn(index);
+            }
+        });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
+
+static void ScanChunk(const QueryOptions& options, ScanTask& task)
+{
+    const char* lineBegin = task.begin;
+    while (lineBegin < task.end) {
+        const char* lineEnd = FindByte(lineBegin, task.end, '\n');
+        LogLine line;
+        if (ParseLogLine(lineBegin, lineEnd, line) && MatchLine(options, line)) {
+            task.output.append(lineBegin, lineEnd);
+            task.output.push_back('\n');
+        }
+        lineBegin = lineEnd == task.end ? lineEnd : lineEnd + 1;
+    }
+}
+
+/**
+ * @brief convert datetime prefix "yyyy-mm-dd HH:MM:SS" in local time to microseconds since epoch,
+ * missing fields are filled with their min or max value
+ */
+static uint64_t DateTimePrefixToMicros(const std::string& datetime, bool upperBound)
+{
+    int fields[6] = { 1970, 1, 1, 0, 0, 0 };
+    const int maxFields[6] = { 9999, 12, 31, 23, 59, 59 };
+    int parsed = std::sscanf(datetime.c_str(), "%d-%d-%d %d:%d:%d",
+        &fields[0], &fields[1], &fields[2], &fields[3], &fields[4], &fields[5]);
+    parsed = std::max(parsed, 0);
+    if (upperBound) {
+        for (int i = parsed; i < 6; i++) {
+            fields[i] = maxFields[i];
+        }
+    }
+    std::tm tm {};
+    tm.tm_year = fields[0] - 1900;
+    tm.tm_mon = fields[1] - 1;
+    tm.tm_mday = fields[2];
+    tm.tm_hour = fields[3];
+    tm.tm_min = fields[4];
+    tm.tm_sec = fields[5];
+    tm.tm_isdst = -1;
+    std::time_t seconds = std::mktime(&tm);
+    if (seconds < 0) {
+        return upperBound ? std::numeric_limits<uint64_t>::max() : 0;
+    }
+    return static_cast<uint64_t>(seconds) * 1000000 + (upperBound ? 999999 : 0);
+}
+
+/**
+ * @brief narrow [begin, end) of a source by its sidecar index when time range is specified
+ */
+static void NarrowByIndex(const QueryOptions& options, const LogSource& source, const char*& begin, const char*& end)
+{
+    std::vector<LogIndexEntry> entries;
+    if ((options.from.empty() && options.to.empty()) || !LoadLogIndex(source.Path(), entries)) {
+        return;
+    }
+    uint64_t beginTime = options.from.empty() ? 0 : DateTimePrefixToMicros(options.from, false);
+    uint64_t endTime = options.to.empty() ? std::numeric_limits<uint64_t>::max() : DateTimePrefixToMicros(options.to, true);
+    uint64_t beginOffset = 0;
+    uint64_t endOffset = 0;
+    std::size_t length = static_cast<std::size_t>(end - begin);
+    if (!LookupLogRange(entries, beginTime, endTime, beginOffset, endOffset)) {
+        // block being written by a live logger is not indexed yet, scan from the last indexed block
+        begin = begin + std::min<uint64_t>(entries.empty() ? 0 : entries.back().offset, length);
+        return;
+    }
+    end = begin + std::min<uint64_t>(endOffset, length);
+    begin = begin + std::min<uint64_t>(beginOffset, length);
+}
+
+// return stamp if name is ${prefix}${stamp}${suffix}
+static bool MatchRotatedFileName(const std::string& name, const std::string& prefix, const std::string& suffix,
+    std::string& stamp)
+{
+    if (name.length() <= prefix.length() + suffix.length() ||
+        name.compare(0, prefix.length(), prefix) != 0 ||
+        name.compare(name.length() - suffix.length(), suffix.length(), suffix) != 0) {
+        return false;
+    }
+    stamp = name.substr(prefix.length(), name.length() - prefix.length() - suffix.length());
+    // "demo.log." should not match rotated files of shard "demo.log.0."
+    if (stamp.length() != ROTATION_STAMP_LENGTH || stamp[8] != '-' || stamp[15] != '.') {
+        return false;
+    }
+    for (std::size_t i = 0; i < stamp.length(); i++) {
+        if (i != 8 && i != 15 && (stamp[i] < '0' || stamp[i] > '9')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief list ${archiveFileName}.${stamp}.zip and rotated ${fileName}.${stamp}.tmp not archived yet
+ * in rotation order, then current log file ${fileName}
+ */
+static std::vector<std::string> ListLogFiles(const std::string& dir, const std::string& fileName, const std::string& archiveFileName)
+{
+#ifdef _WIN32
+    const std::string separator = "\\";
+#else
+    const std::string separator = "/";
+#endif
+    std::vector<std::string> names;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE handle = ::FindFirstFileA((dir + separator + "*").c_str(), &data);
+    if (handle != INVALID_HANDLE_VALUE) {
+        do {
+            names.push_back(data.cFileName);
+        } while (::FindNextFileA(handle, &data));
+        ::FindClose(handle);
+    }
+#else
+    DIR* dirp = ::opendir(dir.c_str());
+    if (dirp != nullptr) {
+        struct dirent* entry = nullptr;
+        while ((entry = ::readdir(dirp)) != nullptr) {
+            names.push_back(entry->d_name);
+        }
+        ::closedir(dirp);
+    }
+#endif
+    // archive is complete once it appears, temp file is removed after that
+    std::map<std::string, std::string> rotatedFiles;
+    std::string stamp;
+    for (const std::string& name : names) {
+        if (MatchRotatedFileName(name, archiveFileName + ".", ARCHIVE_FILE_EXTENSION, stamp)) {
+            rotatedFiles[stamp] = dir + separator + name;
+        }
+    }
+    for (const std::string& name : names) {
+        if (MatchRotatedFileName(name, fileName + ".", TEMP_FILE_EXTENSION, stamp) &&
+            rotatedFiles.find(stamp) == rotatedFiles.end()) {
+            rotatedFiles[stamp] = dir + separator + name;
+        }
+    }
+    std::vector<std::string> files;
+    for (const std::pair<const std::string, std::string>& rotatedFile : rotatedFiles) {
+        files.push_back(rotatedFile.second);
+    }
+    files.push_back(dir + separator + fileName);
+    return files;
+}
+
+// datetime field of a matched line, lexicographical order is chronological order since it's fixed width
+static StringRef LineDatetime(const char* begin, const char* end)
+{
+    if (begin == end || *begin != '[') {
+        return StringRef();
+    }
+    const char* datetimeEnd = FindByte(begin + 1, end, ']');
+    return StringRef(begin + 1, static_cast<std::size_t>(datetimeEnd - begin - 1));
+}
+
+/**
+ * @brief merge matched lines of groups by datetime. Threads of a logger read clock before their records are
+ * serialized, so lines of a group are only roughly in time order and all lines are sorted. Lines of the same
+ * datetime keep the order of groups and of files, a line without datetime stays after the line before it.
+ */
+static void WriteMergedOutputs(const std::vector<std::string>& outputs)
+{
+    struct Line {
+        StringRef       datetime;
+        const char*     begin;
+        const char*     end;
+    };
+    std::vector<Line> lines;
+    for (const std::string& output : outputs) {
+        const char* begin = output.data();
+        const char* end = begin + output.length();
+        StringRef datetime;
+        while (begin < end) {
+            const char* lineEnd = FindByte(begin, end, '\n');
+            lineEnd = lineEnd == end ? end : lineEnd + 1;
+            StringRef lineDatetime = LineDatetime(begin, lineEnd);
+            if (lineDatetime.length != 0) {
+                datetime = lineDatetime;
+            }
+            lines.push_back(Line { datetime, begin, lineEnd });
+            begin = lineEnd;
+        }
+    }
+    std::stable_sort(lines.begin(), lines.end(), [](const Line& a, const Line& b) {
+        int ret = std::memcmp(a.datetime.data, b.datetime.data, std::min(a.datetime.length, b.datetime.length));
+        return ret < 0 || (ret == 0 && a.datetime.length < b.datetime.length);
+    });
+    for (const Line& line : lines) {
+        std::fwrite(line.begin, 1, line.end - line.begin, stdout);
+    }
+}
+
+static void PrintUsage()
+{
+    std::cerr
+        << "usage: minilogger_query [options] [file...]" << std::endl
+        << "  --dir <path> --name <fileName> [--archive <archiveFileName>]" << std::endl
+        << "                       query current log, rotated and archived logs of a logger" << std::endl
+        << "  --from <datetime>    records not earlier than datetime, e.g. \"2023-06-23 14:02\"" << std::endl
+        << "  --to <datetime>      records not later than datetime prefix, e.g. \"2023-06-23 14:05\"" << std::endl
+        << "  --level <level>      min level, DBG/INFO/WARN/ERR/FATAL" << std::endl
+        << "  --function <str>     function contains str" << std::endl
+        << "  --thread <id>        thread id equals id" << std::endl
+        << "  --key <str>          thread local key contains str" << std::endl
+        << "  --grep <str>         message contains str" << std::endl
+        << "  --regex <pattern>    message matches ECMAScript regex" << std::endl
+        << "  --threads <n>        number of worker threads" << std::endl
+        << "  --shards <n>         logger writes ${name}.0 ... ${name}.n-1, merge them by datetime" << std::endl;
+}
+
+static bool ParseOptions(int argc, char** argv, QueryOptions& options)
+{
+    std::string dir;
+    std::string name;
+    std::string archive;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg.compare(0, 2, "--") == 0 && !hasValue) {
+            return false;
+        }
+        if (arg == "--dir") {
+            dir = argv[++i];
+        } else if (arg == "--name") {
+            name = argv[++i];
+        } else if (arg == "--archive") {
+            archive = argv[++i];
+        } else if (arg == "--from") {
+            options.from = argv[++i];
+        } else if (arg == "--to") {
+            options.to = argv[++i];
+        } else if (arg == "--level") {
+            std::string level = argv[++i];
+            options.minLevel = ParseLevel(StringRef { level.c_str(), level.length() });
+            if (options.minLevel < 0) {
+                return false;
+            }
+        } else if (arg == "--function") {
+            options.function = argv[++i];
+        } else if (arg == "--thread") {
+            options.threadID = argv[++i];
+        } else if (arg == "--key") {
+            options.key = argv[++i];
+        } else if (arg == "--grep") {
+            options.substring = argv[++i];
+        } else if (arg == "--regex") {
+            try {
+                options.regex.reset(new std::regex(argv[++i]));
+            } catch (const std::regex_error& e) {
+                std::cerr << "invalid regex: " << e.what() << std::endl;
+                return false;
+            }
+        } else if (arg == "--threads") {
+            options.threads = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--shards") {
+            options.shards = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg.compare(0, 2, "--") == 0) {
+            return false;
+        } else {
+            options.paths.push_back(arg);
+        }
+    }
+    // files given explicitly come first, each of them is a merge group
+    for (std::size_t i = 0; i < options.paths.size(); i++) {
+        options.pathGroups.push_back(options.shards + static_cast<uint32_t>(i));
+    }
+    options.groupsNum = options.shards + static_cast<uint32_t>(options.paths.size());
+    if (!dir.empty() && !name.empty() && options.shards == 0) {
+        std::vector<std::string> files = ListLogFiles(dir, name, archive.empty() ? name : archive);
+        options.paths.insert(options.paths.end(), files.begin(), files.end());
+    }
+    for (uint32_t shard = 0; !dir.empty() && !name.empty() && shard < options.shards; shard++) {
+        std::string suffix = "." + std::to_string(shard);
+        std::vector<std::string> files = ListLogFiles(dir, name + suffix, (archive.empty() ? name : archive) + suffix);
+        options.paths.insert(options.paths.end(), files.begin(), files.end());
+        options.pathGroups.insert(options.pathGroups.end(), files.size(), shard);
+    }
+    if (options.threads == 0) {
+        options.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return !options.paths.empty();
+}
+
+int main(int argc, char** argv)
+{
+    QueryOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return 1;
+    }
+    // load sources in parallel, archives are decompressed here
+    std::vector<std::unique_ptr<LogSource>> sources;
+    for (const std::string& path : options.paths) {
+        sources.emplace_back(new LogSource(path));
+    }
+    std::vector<char> loaded(sources.size(), 0);
+    ParallelFor(sources.size(), options.threads, [&](std::size_t i) {
+        loaded[i] = sources[i]->Load() ? 1 : 0;
+    });
+    // split sources into chunks at line boundary
+    std::vector<ScanTask> tasks;
+    for (std::size_t i = 0; i < sources.size(); i++) {
+        if (!loaded[i]) {
+            std::cerr << "failed to load " << sources[i]->Path() << std::endl;
+            continue;
+        }
+        const char* begin = sources[i]->Data();
+        const char* end = begin + sources[i]->Length();
+        NarrowByIndex(options, *sources[i], begin, end);
+        while (begin < end) {
+            const char* chunkEnd = begin + std::min<std::size_t>(CHUNK_SIZE, end - begin);
+            if (chunkEnd != end) {
+                chunkEnd = FindByte(chunkEnd, end, '\n');
+                chunkEnd = chunkEnd == end ? end : chunkEnd + 1;
+            }
+            tasks.push_back(ScanTask { i, begin, chunkEnd, std::string() });
+            begin = chunkEnd;
+        }
+    }
+    ParallelFor(tasks.size(), options.threads, [&](std::size_t i) {
+        ScanChunk(options, tasks[i]);
+    });
+    if (options.shards != 0) {
+        std::vector<std::string> outputs(options.groupsNum);
+        for (const ScanTask& task : tasks) {
+            outputs[options.pathGroups[task.sourceIndex]] += task.output;
+        }
+        WriteMergedOutputs(outputs);
+        return 0;
+    }
+    for (const ScanTask& task : tasks) {
+        std::fwrite(task.output.data(), 1, task.output.length(), stdout);
+    }
+    return 0;
+}